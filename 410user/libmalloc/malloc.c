@@ -49,10 +49,28 @@ _calloc( size_t __nelt, size_t __eltsize )
 	if( !new ) {
 		return NULL;
 	}
-	bzero( new, __nelt * __eltsize );
+	/* Pages of their own come zeroed from the kernel */
+	if( !GET_MAPPED( HDRP(new) ) ) {
+		bzero( new, __nelt * __eltsize );
+	}
 	return new;
 }
 
+/*
+ * wrapper around the mm_malloc library mm_memalign
+ */
+void *
+_memalign( size_t __align, size_t __size )
+{
+	if( !inited ) {
+		if ( mm_init() < 0 ) {
+			return NULL;
+		}
+		inited = 1;
+	}
+	return mm_memalign( __align, __size );
+}
+
 /*
  * wrapper around the mm_malloc library mm_realloc
  */
@@ -8,6 +8,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <syscall.h>
+#include <string.h>
 
 /* #define PAGE_SIZE       0x00001000 */
 /* #define PAGE_ALIGN_MASK 0xFFFFF000 */
@@ -17,31 +18,81 @@
 #define NULL 0
 #endif
 
+/* Mappings made with mem_map live in [MEM_MAP_LOW, MEM_MAP_TOP), above
+ * the most the heap may grow to and below the thread stacks.
+ */
+#define MEM_MAP_LOW  ((char *)0x80000000)
+#define MEM_MAP_TOP  ((char *)0xb0000000)
+#define MEM_MAX_MAPS 512
+
+/* The heap is committed in chunks, each with its own new_pages call so
+ * that it can be given back with remove_pages. Each chunk is twice the
+ * size of the one before, up to mem_grow_max. Once half the table is
+ * used the cap no longer applies, so that the table never fills up.
+ */
+#define MEM_MAX_CHUNKS 1024
+#define MEM_GROW_MAX (1024 * 1024)  /* Default cap on one chunk */
+
 /* private global variables */
 static char *mem_max_addr;   /* max virtual address for the heap */
 static char *mem_brkp; /* Simulated brk pointer */
 static char *mem_alloctop; /* Maximum allocated address */
+static unsigned int mem_grow = PAGE_SIZE; /* Size of the next chunk */
+static unsigned int mem_grow_max = MEM_GROW_MAX;
+
+/* Heap chunk bases, lowest first */
+static char *mem_chunks[MEM_MAX_CHUNKS];
+static int mem_nchunks;
+
+/* Live mappings, highest address first */
+static struct {
+  char *addr;
+  unsigned int len;
+} mem_maps[MEM_MAX_MAPS];
+static int mem_nmaps;
 
 extern void *_end; /* The end of the ELF binary address space */
 
 /* 
- * mem_init - initializes the memory system model
+ * mem_init - initializes the memory system model. The first page of the
+ *    heap is the first one above the binary which new_pages gives us.
+ *    Should there be pages there, we skip further ahead each time
+ *    rather than trying every page.
  */
 void mem_init(int max_heap_addr)
 {
+  unsigned int skip = PAGE_SIZE;
+
   /* The max address for the heap. */
   mem_max_addr = (char*)max_heap_addr;
+  if (mem_max_addr > MEM_MAP_LOW)
+    mem_max_addr = MEM_MAP_LOW;
   mem_brkp = (char*)&_end + PAGE_SIZE;
   mem_brkp = (char*)((int)mem_brkp & PAGE_ALIGN_MASK);
-  while (new_pages(mem_brkp, PAGE_SIZE))
-    mem_brkp += PAGE_SIZE;
+  while (new_pages(mem_brkp, PAGE_SIZE)) {
+    mem_brkp += skip;
+    skip *= 2;
+  }
   mem_alloctop = mem_brkp + PAGE_SIZE;
+  mem_chunks[0] = mem_brkp;
+  mem_nchunks = 1;
+  mem_grow = 2 * PAGE_SIZE;
+}
+
+/*
+ * mem_policy - sets the most the heap is grown by at once, when it does
+ *    not need more. A grow_max of 0 leaves the cap as it is.
+ */
+void mem_policy(unsigned int grow_max)
+{
+  if (grow_max != 0)
+    mem_grow_max = (grow_max + PAGE_SIZE - 1) & PAGE_ALIGN_MASK;
 }
 
 /* 
  * mem_sbrk - simply uses the the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    Pages are committed a chunk at a time, see mem_grow.
  */
 void *mem_sbrk(int incr) 
 {
@@ -53,20 +104,137 @@ void *mem_sbrk(int incr)
     }
 
     if (old_brk + incr > mem_alloctop) {
-      int allocincr = old_brk + incr - mem_alloctop;
+      unsigned int allocincr = old_brk + incr - mem_alloctop;
       allocincr += PAGE_SIZE - 1;
       allocincr &= PAGE_ALIGN_MASK;
 
-      /* Issue a SBRK for more memory. */
-      if (new_pages((void*)mem_alloctop, allocincr)) {
+      if (mem_nchunks == MEM_MAX_CHUNKS)
+	return (void *)NULL;
+
+      /* Take a whole chunk if it fits below the max address, and
+       * fall back to just what is needed if new_pages fails. */
+      if (allocincr < mem_grow &&
+	  mem_grow <= (unsigned int)(mem_max_addr - mem_alloctop) &&
+	  new_pages((void*)mem_alloctop, mem_grow) == 0) {
+	allocincr = mem_grow;
+      } else if (new_pages((void*)mem_alloctop, allocincr)) {
 	return (void *)NULL;
       }
 
+      mem_chunks[mem_nchunks++] = mem_alloctop;
       mem_alloctop += allocincr;
+      if (mem_grow < mem_grow_max || mem_nchunks > MEM_MAX_CHUNKS / 2)
+	mem_grow *= 2;
+      if (mem_grow > mem_grow_max && mem_nchunks <= MEM_MAX_CHUNKS / 2)
+	mem_grow = mem_grow_max;
     }
 
     mem_brkp += incr;
 
     return (void *)old_brk;
 }
+
+/*
+ * mem_trim - gives back with remove_pages the chunks at the top of the
+ *    heap which lie wholly above lo. The break moves down to the top of
+ *    the highest chunk left. Returns the new break.
+ */
+void *mem_trim(void *lo)
+{
+    while (mem_nchunks > 1 && mem_chunks[mem_nchunks - 1] >= (char *)lo) {
+      if (remove_pages(mem_chunks[mem_nchunks - 1]))
+	break;
+      mem_alloctop = mem_chunks[--mem_nchunks];
+    }
+    if (mem_brkp > mem_alloctop)
+      mem_brkp = mem_alloctop;
+    /* Grow back from where the sizes were when we were this small */
+    while (mem_grow > 2 * PAGE_SIZE &&
+	   mem_grow / 2 >= (unsigned int)(mem_alloctop - mem_chunks[0]))
+      mem_grow /= 2;
+    return mem_brkp;
+}
+
+/*
+ * mem_map - maps len bytes, a multiple of PAGE_SIZE, of fresh zeroed
+ *    pages outside the heap with new_pages. The highest gap between the
+ *    live mappings which fits is used. Returns NULL if there is no room
+ *    or new_pages fails.
+ */
+void *mem_map(unsigned int len)
+{
+    char *top = MEM_MAP_TOP, *addr = NULL;
+    int i;
+
+    if (len == 0 || (len & (PAGE_SIZE - 1)) || mem_nmaps == MEM_MAX_MAPS)
+      return NULL;
+
+    for (i = 0; addr == NULL && i <= mem_nmaps; i++) {
+      char *bottom = (i < mem_nmaps) ?
+                     mem_maps[i].addr + mem_maps[i].len : MEM_MAP_LOW;
+      if ((unsigned int)(top - bottom) >= len)
+        addr = top - len;
+      else
+        top = mem_maps[i].addr;
+    }
+    i--;
+    if (addr == NULL || new_pages(addr, len))
+      return NULL;
+
+    memmove(&mem_maps[i + 1], &mem_maps[i],
+            (mem_nmaps - i) * sizeof(mem_maps[0]));
+    mem_maps[i].addr = addr;
+    mem_maps[i].len = len;
+    mem_nmaps++;
+    return addr;
+}
+
+/*
+ * mem_map_find - returns the index of the mapping starting at addr, -1
+ *    if there is none
+ */
+static int mem_map_find(void *addr)
+{
+    int lo = 0, hi = mem_nmaps - 1, mid;
+
+    while (lo <= hi) {
+      mid = (lo + hi) / 2;
+      if (mem_maps[mid].addr == addr)
+        return mid;
+      if (mem_maps[mid].addr > (char *)addr)
+        lo = mid + 1;
+      else
+        hi = mid - 1;
+    }
+    return -1;
+}
+
+/*
+ * mem_map_size - returns the length of the mapping starting at addr, 0
+ *    if addr does not start a mapping
+ */
+unsigned int mem_map_size(void *addr)
+{
+    int i = mem_map_find(addr);
+
+    return (i < 0) ? 0 : mem_maps[i].len;
+}
+
+/*
+ * mem_unmap - gives back the mapping starting at addr with remove_pages.
+ *    Returns its length, 0 if addr does not start a mapping.
+ */
+unsigned int mem_unmap(void *addr)
+{
+    int i = mem_map_find(addr);
+    unsigned int len;
+
+    if (i < 0 || remove_pages(addr))
+      return 0;
+    len = mem_maps[i].len;
+    mem_nmaps--;
+    memmove(&mem_maps[i], &mem_maps[i + 1],
+            (mem_nmaps - i) * sizeof(mem_maps[0]));
+    return len;
+}
 /* $end memlib */
@@ -9,5 +9,10 @@
 
 void *mem_init(int size);
 void *mem_sbrk(int incr);
+void mem_policy(unsigned int grow_max);
+void *mem_trim(void *lo);
+void *mem_map(unsigned int len);
+unsigned int mem_map_size(void *addr);
+unsigned int mem_unmap(void *addr);
 
 #endif /* _MEMLIB_H */
@@ -3,7 +3,7 @@
  */
  
 /* 
- * Simple allocator based on implicit free lists with boundary 
+ * Simple allocator based on segregated explicit free lists with boundary 
  * tag coalescing. Each block has header and footer of the form:
  * 
  *      31                     3  2  1  0 
@@ -24,6 +24,29 @@
  *
  * The allocated prologue and epilogue blocks are overhead that
  * eliminate edge conditions during coalescing.
+ *
+ * Free blocks keep pointers to the next and previous free block of
+ * their size class in the first two words of their payload, which is
+ * why no block is smaller than MINBLOCK. Blocks of up to SMALL_MAX bytes
+ * have one class per size, so any block of the class fits and malloc
+ * takes the first one. Larger blocks have one class per power of 2,
+ * which is searched first fit. A bitmap of the classes which are not
+ * empty finds the next larger class with a block in it.
+ *
+ * Requests of at least MMAP_THRESHOLD bytes are not placed in the heap.
+ * They get pages of their own from mem_map, which are given back with
+ * mem_unmap when the block is freed. Such a block has a header, with
+ * the MAPPED bit set and the size of the mapping, but no footer. It
+ * starts DSIZE bytes into its first page.
+ *
+ * memlib commits the pages under the heap in chunks which grow
+ * geometrically, so extending the heap rarely costs a system call.
+ * mm_trim gives the chunks under a free block at the end of the heap
+ * back.
+ *
+ * The statistics mm_stats reports are kept up to date as blocks move
+ * on and off the free lists and the heap grows and shrinks, so no walk
+ * of the heap is needed.
  */
 #include "mm_malloc.h"
 #include <memlib.h>
@@ -31,9 +54,12 @@
 #include <string.h>
 #include <stdio.h>
 #include <simics.h>
+#include <syscall.h>
 
-/* The only global variable is a pointer to the first block */
-static char *heap_listp;   
+static char *heap_listp;    /* Pointer to the first block */
+static char *seg_lists[NCLASSES];   /* First free block of each class */
+static unsigned int seg_nonempty[(NCLASSES + 31) / 32];
+static mm_stats_t stats;
 
 /* function prototypes for internal helper routines */
 static void *extend_heap(int words);
@@ -42,6 +68,26 @@ static void *find_fit(int asize);
 static void *coalesce(void *bp);
 static void printblock(void *bp); 
 static void checkblock(void *bp);
+static int size_class(int asize);
+static void insert_free(void *bp);
+static void remove_free(void *bp);
+static int next_class(int c);
+static void *map_block(int size);
+static void *heap_alloc(int asize);
+static int resize_block(void *bp, int asize);
+static void split_block(void *bp, int asize);
+static int largest_free(void);
+
+/* note a new high of the bytes in allocated blocks */
+static inline void
+note_peak( void )
+{
+	unsigned int used = stats.heap_bytes - stats.free_bytes +
+	                    stats.mapped_bytes;
+
+	if ( used > stats.peak_bytes )
+		stats.peak_bytes = used;
+}
 
 /* inline helper function */
 static inline unsigned int
@@ -59,6 +105,9 @@ int mm_init(void)
   
     /* create the initial empty heap */
   mem_init(0xffffffff);
+  memset(seg_lists, 0, sizeof(seg_lists));
+  memset(seg_nonempty, 0, sizeof(seg_nonempty));
+  memset(&stats, 0, sizeof(stats));
   
   if ((heap_listp = mem_sbrk(4*WSIZE)) == NULL)
     return -1;
@@ -83,7 +132,6 @@ int mm_init(void)
 void *mm_malloc(int size) 
 {
     int asize;      /* adjusted block size */
-    int extendsize; /* amount to extend heap if no fit */
     char *bp;      
 
     /* Ignore spurious requests */
@@ -91,28 +139,55 @@ void *mm_malloc(int size)
 		return NULL;
 	 }
     /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)
-	asize = DSIZE + OVERHEAD;
-    else
-	asize = DSIZE * ((size + (OVERHEAD) + (DSIZE-1)) / DSIZE);
-    
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-		place(bp, asize);
-		return bp;
-	 }
-
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL) {
-		return NULL;
-	 }
-    place(bp, asize);
-    
+    asize = ADJUST_SIZE(size);
+    if ((size < MMAP_THRESHOLD || (bp = map_block(size)) == NULL) &&
+	(bp = heap_alloc(asize)) == NULL)
+	return NULL;
+    note_peak();
     return bp;
 } 
 /* $end mmmalloc */
 
+/*
+ * mm_memalign - Allocate a block with at least size bytes of payload
+ *               which starts at a multiple of align, a power of 2. The
+ *               block is cut from a larger one, whose head and tail are
+ *               freed. It is never mapped, as mapped blocks start DSIZE
+ *               bytes into their pages.
+ */
+void *mm_memalign(int align, int size)
+{
+    int asize, csize, front;
+    char *bp, *abp;
+
+    if (size <= 0 || align <= 0 || (align & (align - 1)))
+	return NULL;
+    if (align <= DSIZE)
+	return mm_malloc(size);
+    asize = ADJUST_SIZE(size);
+    if (asize > 0x7fffffff - align - MINBLOCK)
+	return NULL;
+
+    /* room for the head to be a free block of its own */
+    if ((bp = heap_alloc(asize + align + MINBLOCK)) == NULL)
+	return NULL;
+    if (((unsigned int)bp & (align - 1)) != 0) {
+	abp = (char *)(((unsigned int)bp + MINBLOCK + align - 1) &
+		       ~(align - 1));
+	front = abp - bp;
+	csize = GET_SIZE(HDRP(bp));
+	PUT(HDRP(abp), PACK(csize - front, 1));
+	PUT(FTRP(abp), PACK(csize - front, 1));
+	PUT(HDRP(bp), PACK(front, 0));
+	PUT(FTRP(bp), PACK(front, 0));
+	insert_free(coalesce(bp));
+	bp = abp;
+    }
+    split_block(bp, asize);
+    note_peak();
+    return bp;
+}
+
 /* 
  * mm_free - Free a block 
  */
@@ -128,41 +203,107 @@ void mm_free(void *bp)
     if (bp != NULL) {
         int size;
 
+        if (GET_MAPPED(HDRP(bp))) {
+            stats.mapped_bytes -= mem_unmap((char *)bp - DSIZE);
+            stats.mapped_blocks--;
+            return;
+        }
         size = GET_SIZE(HDRP(bp));
 
         PUT(HDRP(bp), PACK(size, 0));
         PUT(FTRP(bp), PACK(size, 0));
-        coalesce(bp);
+        insert_free(coalesce(bp));
     }
 }
 
 /* $end mmfree */
 
-/* Not implemented. For consistency with 15-213 malloc driver */
+/*
+ * mm_realloc - Resize a block, in place when we can. A block shrinks by
+ *              freeing its tail, and grows into the free block after it
+ *              or by extending the heap if it is the last block. Only
+ *              otherwise is the payload copied to a new block.
+ */
 void *mm_realloc(void *ptr, int size)
 {
 	unsigned int old_size;
 	unsigned int *new_chunk;
 
+	if( ptr && size > 0 ) {
+		if( GET_MAPPED( HDRP(ptr) ) ) {
+			/* keep the pages while the request still wants them */
+			if( size >= MMAP_THRESHOLD &&
+			    size <= GET_SIZE( HDRP(ptr) ) - DSIZE )
+				return ptr;
+		} else if( resize_block( ptr, ADJUST_SIZE(size) ) ) {
+			return ptr;
+		}
+	}
+
 	new_chunk = mm_malloc( size );
 	if( !new_chunk ) {
 		return NULL;
 	}
 
 	if( ptr ) {
-		old_size = GET_SIZE( HDRP(ptr) );
+		/* payload size, mapped blocks have no footer */
+		old_size = GET_SIZE( HDRP(ptr) ) -
+		           ( GET_MAPPED( HDRP(ptr) ) ? DSIZE : OVERHEAD );
 		memcpy( new_chunk, ptr, min( old_size, size ) );
 		mm_free( ptr );
 	}
 	return new_chunk;
 }
 
+/*
+ * mm_trim - Give back the pages under the free block at the end of the
+ *           heap, if there is one, but for pad bytes of it. Returns 1 if
+ *           any pages were given back, 0 if not.
+ */
+int mm_trim(int pad)
+{
+    char *brk, *bp, *newbrk;
+    int size;
+
+    if (heap_listp == NULL || pad < 0)
+	return 0;
+    brk = mem_sbrk(0);
+    if (GET_ALLOC(brk - DSIZE))
+	return 0;
+    bp = PREV_BLKP(brk);
+
+    /* What is left of the block must still be a block */
+    pad = DSIZE * ((pad + DSIZE - 1) / DSIZE);
+    newbrk = mem_trim(bp + MAX(pad, MINBLOCK));
+    if (newbrk == brk)
+	return 0;
+
+    remove_free(bp);
+    size = newbrk - bp;
+    stats.heap_bytes -= GET_SIZE(HDRP(bp)) - size;
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    PUT(HDRP(newbrk), PACK(0, 1));   /* new epilogue header */
+    insert_free(bp);
+    return 1;
+}
+
+/*
+ * mm_stats - Fill in the statistics of the heap
+ */
+void mm_stats(mm_stats_t *st)
+{
+    *st = stats;
+    st->largest = largest_free();
+}
+
 /* 
  * mm_checkheap - Check the heap for consistency 
  */
 void mm_checkheap(int verbose) 
 {
     char *bp = heap_listp;
+    int c;
 
     if (verbose)
 	lprintf("Heap (%p):\n", heap_listp);
@@ -181,6 +322,19 @@ void mm_checkheap(int verbose)
 	printblock(bp);
     if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
 	lprintf("Bad epilogue header\n");
+
+    for (c = 0; c < NCLASSES; c++) {
+	if (!seg_lists[c] != !(seg_nonempty[c / 32] & (1u << (c % 32))))
+	    lprintf("Error: bitmap wrong for class %d\n", c);
+	for (bp = seg_lists[c]; bp != NULL; bp = NEXT_FREEP(bp)) {
+	    if (GET_ALLOC(HDRP(bp)))
+		lprintf("Error: %p allocated but on a free list\n", bp);
+	    if (size_class(GET_SIZE(HDRP(bp))) != c)
+		lprintf("Error: %p on the free list of class %d\n", bp, c);
+	    if (NEXT_FREEP(bp) != NULL && PREV_FREEP(NEXT_FREEP(bp)) != bp)
+		lprintf("Error: free list links broken at %p\n", bp);
+	}
+    }
 }
 
 /* The remaining routines are internal helper routines */
@@ -198,6 +352,7 @@ static void *extend_heap(int words)
     size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
     if ((bp = mem_sbrk(size)) == NULL) 
 	return NULL;
+    stats.heap_bytes += size;
 
     /* Initialize free block header/footer and the epilogue header */
     PUT(HDRP(bp), PACK(size, 0));         /* free block header */
@@ -205,7 +360,9 @@ static void *extend_heap(int words)
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
 
     /* Coalesce if the previous block was free */
-    return coalesce(bp);
+    bp = coalesce(bp);
+    insert_free(bp);
+    return bp;
 }
 /* $end mmextendheap */
 
@@ -220,12 +377,14 @@ static void place(void *bp, int asize)
 {
     int csize = GET_SIZE(HDRP(bp));   
 
-    if ((csize - asize) >= (DSIZE + OVERHEAD)) { 
+    remove_free(bp);
+    if ((csize - asize) >= MINBLOCK) { 
 	PUT(HDRP(bp), PACK(asize, 1));
 	PUT(FTRP(bp), PACK(asize, 1));
 	bp = NEXT_BLKP(bp);
 	PUT(HDRP(bp), PACK(csize-asize, 0));
 	PUT(FTRP(bp), PACK(csize-asize, 0));
+	insert_free(bp);
     }
     else { 
 	PUT(HDRP(bp), PACK(csize, 1));
@@ -242,20 +401,214 @@ static void place(void *bp, int asize)
 static void *find_fit(int asize)
 /* $end mmfirstfit-proto */
 {
-    void *bp;
+    char *bp;
+    int c = size_class(asize);
 
-    /* first fit search */
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-	if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp)))) {
-	    return bp;
+    /* first fit search of the class of asize, unless all of it fits */
+    if (c >= SMALL_CLASSES) {
+	for (bp = seg_lists[c]; bp != NULL; bp = NEXT_FREEP(bp)) {
+	    if (asize <= GET_SIZE(HDRP(bp)))
+		return bp;
 	}
+	c++;
     }
-    return NULL; /* no fit */
+
+    /* any block of a larger class fits */
+    if ((c = next_class(c)) < 0)
+	return NULL; /* no fit */
+    return seg_lists[c];
 }
 /* $end mmfirstfit */
 
 /*
- * coalesce - boundary tag coalescing. Return ptr to coalesced block
+ * heap_alloc - Allocate a block of asize bytes from the heap, extending
+ *              it if no free block fits
+ */
+static void *heap_alloc(int asize)
+{
+    int extendsize; /* amount to extend heap if no fit */
+    char *bp;
+
+    /* Search the free list for a fit */
+    if ((bp = find_fit(asize)) != NULL) {
+	place(bp, asize);
+	return bp;
+    }
+
+    /* No fit found. Get more memory and place the block */
+    extendsize = MAX(asize,CHUNKSIZE);
+    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+	return NULL;
+    place(bp, asize);
+    return bp;
+}
+
+/*
+ * resize_block - Make the allocated block bp asize bytes large without
+ *                moving it. Returns 1 on success, 0 if it can not grow
+ *                in place.
+ */
+static int resize_block(void *bp, int asize)
+{
+    int csize = GET_SIZE(HDRP(bp));
+    char *next = NEXT_BLKP(bp);
+    int avail = csize;
+
+    if (asize <= csize) {
+	split_block(bp, asize);
+	return 1;
+    }
+
+    if (!GET_ALLOC(HDRP(next))) {
+	avail += GET_SIZE(HDRP(next));
+	next = NEXT_BLKP(next);
+    }
+    if (avail < asize) {
+	/* the heap can only be extended under the last block */
+	if (GET_SIZE(HDRP(next)) != 0 ||
+	    extend_heap(MAX(asize - avail, CHUNKSIZE)/WSIZE) == NULL)
+	    return 0;
+    }
+
+    /* the free block after bp, which extend_heap coalesced with any
+     * free block before the old epilogue, now fits */
+    next = NEXT_BLKP(bp);
+    remove_free(next);
+    csize += GET_SIZE(HDRP(next));
+    PUT(HDRP(bp), PACK(csize, 1));
+    PUT(FTRP(bp), PACK(csize, 1));
+    split_block(bp, asize);
+    note_peak();
+    return 1;
+}
+
+/*
+ * split_block - Free all but the first asize bytes of the allocated
+ *               block bp, if what is left would be at least MINBLOCK
+ */
+static void split_block(void *bp, int asize)
+{
+    int csize = GET_SIZE(HDRP(bp));
+
+    if ((csize - asize) < MINBLOCK)
+	return;
+    PUT(HDRP(bp), PACK(asize, 1));
+    PUT(FTRP(bp), PACK(asize, 1));
+    bp = NEXT_BLKP(bp);
+    PUT(HDRP(bp), PACK(csize-asize, 0));
+    PUT(FTRP(bp), PACK(csize-asize, 0));
+    insert_free(coalesce(bp));
+}
+
+/*
+ * map_block - Give a request of size bytes pages of its own. Returns
+ *             NULL if they can not be mapped.
+ */
+static void *map_block(int size)
+{
+    unsigned int len = (size + DSIZE + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    char *pages = mem_map(len);
+
+    if (pages == NULL)
+	return NULL;
+    PUT(pages + WSIZE, PACK(len, MAPPED | 1));
+    stats.mapped_bytes += len;
+    stats.mapped_blocks++;
+    return pages + DSIZE;
+}
+
+/*
+ * size_class - Return the free list class of blocks of asize bytes
+ */
+static int size_class(int asize)
+{
+    unsigned int n;
+    int c;
+
+    if (asize <= SMALL_MAX)
+	return (asize - MINBLOCK) / DSIZE;
+    c = SMALL_CLASSES;
+    for (n = (asize - 1) / (2 * SMALL_MAX); n != 0; n >>= 1)
+	c++;
+    return (c < NCLASSES) ? c : NCLASSES - 1;
+}
+
+/*
+ * next_class - Return the first class from c on which is not empty,
+ *              -1 if there is none
+ */
+static int next_class(int c)
+{
+    unsigned int bits;
+    int w;
+
+    for (w = c / 32; c < NCLASSES; w++, c = w * 32) {
+	bits = seg_nonempty[w] & (~0u << (c % 32));
+	if (bits != 0)
+	    return w * 32 + __builtin_ctz(bits);
+    }
+    return -1;
+}
+
+/*
+ * largest_free - Return the size of the largest free block, 0 if there
+ *                is none. Only the largest class which is not empty is
+ *                searched.
+ */
+static int largest_free(void)
+{
+    int c, largest = 0;
+    char *bp;
+
+    for (c = NCLASSES - 1; c >= 0 && seg_lists[c] == NULL; c--)
+	;
+    for (bp = (c >= 0) ? seg_lists[c] : NULL; bp != NULL; bp = NEXT_FREEP(bp))
+	largest = MAX(largest, GET_SIZE(HDRP(bp)));
+    return largest;
+}
+
+/*
+ * insert_free - Push a free block onto the list of its class
+ */
+static void insert_free(void *bp)
+{
+    int c = size_class(GET_SIZE(HDRP(bp)));
+
+    NEXT_FREEP(bp) = seg_lists[c];
+    PREV_FREEP(bp) = NULL;
+    if (seg_lists[c] != NULL)
+	PREV_FREEP(seg_lists[c]) = bp;
+    seg_lists[c] = bp;
+    seg_nonempty[c / 32] |= 1u << (c % 32);
+    stats.free_bytes += GET_SIZE(HDRP(bp));
+    stats.free_blocks++;
+    stats.class_count[c]++;
+}
+
+/*
+ * remove_free - Unlink a free block from the list of its class
+ */
+static void remove_free(void *bp)
+{
+    int c = size_class(GET_SIZE(HDRP(bp)));
+
+    if (PREV_FREEP(bp) != NULL)
+	NEXT_FREEP(PREV_FREEP(bp)) = NEXT_FREEP(bp);
+    else
+	seg_lists[c] = NEXT_FREEP(bp);
+    if (NEXT_FREEP(bp) != NULL)
+	PREV_FREEP(NEXT_FREEP(bp)) = PREV_FREEP(bp);
+    if (seg_lists[c] == NULL)
+	seg_nonempty[c / 32] &= ~(1u << (c % 32));
+    stats.free_bytes -= GET_SIZE(HDRP(bp));
+    stats.free_blocks--;
+    stats.class_count[c]--;
+}
+
+/*
+ * coalesce - boundary tag coalescing. Return ptr to coalesced block,
+ *            which is on no free list. Free neighbours are taken off
+ *            theirs.
  */
 /* $begin mmfree */
 static void *coalesce(void *bp) 
@@ -269,6 +622,7 @@ static void *coalesce(void *bp)
     }
 
     else if (prev_alloc && !next_alloc) {      /* Case 2 */
+	remove_free(NEXT_BLKP(bp));
 	size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
 	PUT(HDRP(bp), PACK(size, 0));
 	PUT(FTRP(bp), PACK(size,0));
@@ -276,6 +630,7 @@ static void *coalesce(void *bp)
     }
 
     else if (!prev_alloc && next_alloc) {      /* Case 3 */
+	remove_free(PREV_BLKP(bp));
 	size += GET_SIZE(HDRP(PREV_BLKP(bp)));
 	PUT(FTRP(bp), PACK(size, 0));
 	PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
@@ -283,6 +638,8 @@ static void *coalesce(void *bp)
     }
 
     else {                                     /* Case 4 */
+	remove_free(PREV_BLKP(bp));
+	remove_free(NEXT_BLKP(bp));
 	size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
 	    GET_SIZE(FTRP(NEXT_BLKP(bp)));
 	PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
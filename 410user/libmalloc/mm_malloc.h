@@ -8,15 +8,27 @@
 #ifndef _MM_MALLOC_H
 #define _MM_MALLOC_H
 
+#include <stddef.h>
+
 /* $begin mallocmacros */
 /* Basic constants and macros */
 #define WSIZE       4       /* word size (bytes) */
 #define DSIZE       8       /* doubleword size (bytes) */
 #define CHUNKSIZE  (1<<12)  /* initial heap size (bytes) */
 #define OVERHEAD    8       /* overhead of header and footer (bytes) */
+#define MINBLOCK    16      /* header, footer and two free list links */
+#define SMALL_MAX   256     /* largest block with a class of its own size */
+#define SMALL_CLASSES ((SMALL_MAX - MINBLOCK) / DSIZE + 1)
+#define NCLASSES    (SMALL_CLASSES + 23)    /* then one per power of 2 */
+#define MMAP_THRESHOLD (128 * 1024) /* requests this large get own pages */
+#define MAPPED      0x2     /* header bit of a block with its own pages */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
 
+/* Block size for a request of size bytes, with overhead and alignment */
+#define ADJUST_SIZE(size) ((size) <= MINBLOCK - OVERHEAD ? MINBLOCK : \
+                           DSIZE * (((size) + OVERHEAD + (DSIZE-1)) / DSIZE))
+
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
 
@@ -27,6 +39,7 @@
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_MAPPED(p) (GET(p) & MAPPED)
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)
@@ -35,11 +48,33 @@
 /* Given block ptr bp, compute address of next and previous blocks */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+
+/* Given free block ptr bp, the next and previous free block of its class */
+#define NEXT_FREEP(bp) (*(char **)(bp))
+#define PREV_FREEP(bp) (*(char **)((char *)(bp) + WSIZE))
 /* $end mallocmacros */
 
+/* Heap statistics, kept up to date by the allocator */
+typedef struct mm_stats {
+    unsigned int heap_bytes;    /* bytes in heap blocks */
+    unsigned int free_bytes;    /* bytes in free heap blocks */
+    unsigned int free_blocks;
+    unsigned int mapped_bytes;  /* bytes in blocks with pages of their own */
+    unsigned int mapped_blocks;
+    unsigned int peak_bytes;    /* most bytes ever in allocated blocks */
+    unsigned int largest;       /* largest free block, set by mm_stats */
+    unsigned int class_count[NCLASSES];     /* free blocks per class */
+} mm_stats_t;
+
 int mm_init(void);
 void *mm_malloc(int size);
 void mm_free(void *bp);
 void *mm_realloc(void *ptr, int size);
+int mm_trim(int pad);
+void *mm_memalign(int align, int size);
+void mm_stats(mm_stats_t *st);
+
+/* Not in malloc.h, which is the 410 interface */
+void *_memalign(size_t __align, size_t __size);
 
 #endif /* _MM_MALLOC_H */
@@ -20,11 +20,17 @@
 #include <stdio.h>
 #include <simics.h>
 #include <assert.h>
+#include <slab.h>
+
+/** @brief where thrgrp_data_t come from, one per spawned thread */
+static kmem_cache_t thrgrp_data_cache =
+  KMEM_CACHE_INITIALIZER(sizeof(thrgrp_data_t), NULL);
 
 /** 
  * @brief Initializes a thread group 
  * 
- * This function basically just initializes mutexes etc.
+ * This function just sets the group to THRGRP_GROUP_INITIALIZER, which
+ * needs no mutex_init or cond_init and so can not fail.
  *
  * @param eg An unitialized, but allocated, thread group to be initialized
  * @return 0 on success, nonzero otherwise
@@ -33,15 +39,8 @@
  * @post eg is initialized
  */
 int thrgrp_init_group(thrgrp_group_t *eg){
-  int ret;
-  eg->zombie_in=NULL;
-  eg->zombie_out=NULL;
-  if((ret=mutex_init(&(eg->lock))))
-    return ret; 
-  if((ret=cond_init(&(eg->cv)))) {
-    mutex_destroy(&(eg->lock));
-    return ret;
-  }
+  static const thrgrp_group_t initial = THRGRP_GROUP_INITIALIZER;
+  *eg = initial;
   return 0;
 }
 
@@ -124,7 +123,7 @@ int thrgrp_create(thrgrp_group_t *tg, void *(*func)(void *),void *arg){
     this is used both to get the arguments into the other thread,
     and then as the memory to go on the zombie queue, this way we only
     malloc once */
-  data = malloc(sizeof(thrgrp_data_t));
+  data = kmem_cache_alloc(&thrgrp_data_cache);
   if(data == NULL)
     return -1;
   data->tmp.func = func;
@@ -136,7 +135,7 @@ int thrgrp_create(thrgrp_group_t *tg, void *(*func)(void *),void *arg){
 
   /* tid<0 indicates error */
   if(tid < 0) {
-    free(data);
+    kmem_cache_free(&thrgrp_data_cache, data);
     return tid;
   }
   
@@ -189,7 +188,7 @@ int thrgrp_join(thrgrp_group_t* eg, void **status){
   /* grab the tid out before we free it */
   tid = thr_data->tid;
   /* free the memory from the queue */
-  free(thr_data);
+  kmem_cache_free(&thrgrp_data_cache, thr_data);
   /* join on the tid, and return the result */
   return thr_join(tid, status);
 }
@@ -35,6 +35,10 @@ typedef struct{
   mutex_t lock;
 } thrgrp_group_t;
 
+/** @brief static initializer, a group set to it needs no thrgrp_init_group */
+#define THRGRP_GROUP_INITIALIZER \
+  { COND_INITIALIZER, NULL, NULL, MUTEX_INITIALIZER }
+
 /**
  * @brief This is a temporary structure used for passing data into a spawned
  * thread
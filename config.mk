@@ -96,12 +96,21 @@ UPDATE_METHOD = afs
 # A list of the test programs you want compiled in from the user/progs
 # directory
 #
-STUDENTTESTS = print_test
+STUDENTTESTS = print_test future_test green_test malloc_bench barrier_test chan_test spsc_test parallel_test
+
+###########################################################################
+# Data files you wish to have in the RAM disk
+###########################################################################
+# A list of the files you want copied in from the user/files directory
+#
+STUDENTFILES = green.rep
 
 ###########################################################################
 # Object files for your thread library
 ###########################################################################
-THREAD_OBJS = asm.o malloc.o panic.o mutex.o cond_var.o thread.o rwlock.o sem.o list.o
+THREAD_OBJS = asm.o malloc.o panic.o mutex.o cond_var.o thread.o rwlock.o sem.o list.o \
+			  pool.o future.o parallel.o green.o barrier.o chan.o spsc.o park.o \
+			  tsd.o once.o stack.o slab.o arena.o mprof.o
 
 # Thread Group Library Support.
 #
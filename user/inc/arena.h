@@ -0,0 +1,32 @@
+/** @file arena.h
+ *  @brief This file defines the type and interface for arenas.
+ *
+ *  An arena hands out memory by bumping a pointer through chunks of
+ *  pages, with no header per allocation. Nothing is freed on its own,
+ *  everything allocated from an arena is freed at once by arena_reset or
+ *  arena_destroy. An arena must not be used by several threads at once.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#define ARENA_CHUNK_SIZE (64 * 1024)    /* Default size of a chunk */
+#define ARENA_ALIGN 8
+
+typedef struct arena {
+    char *next;                 /* Next free byte of the current chunk */
+    char *end;                  /* End of the current chunk */
+    void *chunks;               /* Chunks other than the first, newest
+                                   first, linked through their first word */
+    unsigned int chunk_size;
+} arena_t;
+
+arena_t *arena_create(unsigned int chunk_size);
+void *arena_alloc(arena_t *arena, unsigned int size);
+void arena_reset(arena_t *arena);
+void arena_destroy(arena_t *arena);
+
+#endif /* _ARENA_H */
@@ -8,13 +8,36 @@
 
 #include <stdint.h>
 
+/** @brief Keep the compiler from moving memory accesses across this point.
+ *  x86 does not reorder stores with stores or loads with loads, so this is
+ *  all a release store or an acquire load needs. */
+#define compiler_barrier() __asm__ __volatile__("" : : : "memory")
+
 /** @brief Atomically test the value of a memory location and set to 0. */
 int test_and_unset(void *target);
 
 /** @brief Atomically test the value of a memory location and set to 1. */
 int test_and_set(void *target);
 
+/** @brief Atomically add value to a memory location, return the old value. */
+int atomic_add(int *target, int value);
+
+/** @brief Atomically set a memory location to new if it holds old.
+ *  Returns the value found at the location. */
+int compare_and_swap(int *target, int old, int new);
+
+/** @brief Atomically store value in a memory location, return the old value. */
+int atomic_exchange(int *target, int value);
+
 /** @brief Thread a fork! */
 int thread_fork(void *stack_base, void *(*func)(void *), void *arg);
 
+/** @brief Set *flag and vanish without touching the stack in between, so
+ *  that whoever waits on the flag may free the stack. */
+void vanish_and_set(int *flag);
+
+/** @brief Save callee save registers and the stack pointer in *save_esp
+ *  and resume the context whose stack pointer is new_esp. */
+void green_switch(void **save_esp, void *new_esp);
+
 #endif /* !X86_ASM_H */
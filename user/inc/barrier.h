@@ -0,0 +1,34 @@
+/** @file barrier.h
+ *  @brief This file defines the type and interface for barriers.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _BARRIER_H
+#define _BARRIER_H
+
+#define BARRIER_CENTRAL 0   /* One node all threads arrive at */
+#define BARRIER_TREE 1      /* Combining tree of BARRIER_FANIN wide nodes */
+
+#define BARRIER_FANIN 4
+#define BARRIER_TREE_THRESHOLD 8    /* barrier_init uses a tree above this */
+
+#define BARRIER_SERIAL_THREAD 1     /* Returned to one thread per phase */
+
+struct barrier_node;
+
+typedef struct barrier {
+    int n;
+    int ticket;                 /* Number of arrivals in this phase */
+    int fanin;
+    int nnodes;
+    struct barrier_node *nodes; /* Leaves first, root last */
+} barrier_t;
+
+int barrier_init(barrier_t *b, int n);
+int barrier_init_mode(barrier_t *b, int n, int mode);
+int barrier_wait(barrier_t *b);
+void barrier_destroy(barrier_t *b);
+
+#endif /* _BARRIER_H */
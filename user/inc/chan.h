@@ -0,0 +1,47 @@
+/** @file chan.h
+ *  @brief This file defines the type and interface for channels.
+ *
+ *  A channel is a bounded queue of fixed size items which any number of
+ *  threads may send to and receive from. Items are copied in and out of
+ *  the channel.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _CHAN_H
+#define _CHAN_H
+
+#include <mutex.h>
+#include <cond.h>
+
+#define CHAN_CACHE_LINE 64
+
+typedef struct chan {
+    unsigned int tail;          /* Next position to send to */
+    char tail_pad[CHAN_CACHE_LINE - sizeof(unsigned int)];
+    unsigned int head;          /* Next position to receive from */
+    char head_pad[CHAN_CACHE_LINE - sizeof(unsigned int)];
+    unsigned int mask;          /* Capacity - 1, capacity is a power of 2 */
+    int elem_size;
+    int stride;                 /* Size of a slot, sequence number included */
+    char *slots;
+    int closed;
+    int send_waiters;           /* Senders parked on a full channel */
+    int recv_waiters;           /* Receivers parked on an empty channel */
+    mutex_t lock;
+    cond_t not_full;
+    cond_t not_empty;
+} chan_t;
+
+int chan_init(chan_t *c, int capacity, int elem_size);
+int chan_send(chan_t *c, const void *item);
+int chan_recv(chan_t *c, void *item);
+int chan_try_send(chan_t *c, const void *item);
+int chan_try_recv(chan_t *c, void *item);
+int chan_send_batch(chan_t *c, const void *items, int n);
+int chan_recv_batch(chan_t *c, void *items, int n);
+void chan_close(chan_t *c);
+void chan_destroy(chan_t *c);
+
+#endif /* _CHAN_H */
@@ -8,10 +8,12 @@
 #define COND_VAR_VALID 1
 #define COND_VAR_INVALID 0
 
+/* Static initializer, a cond var set to it needs no cond_init */
+#define COND_INITIALIZER { 0, COND_VAR_VALID }
+
 typedef struct cond {
+    int seq;        /* Bumped by every signal and broadcast */
     int status;
-    list_head waiting;
-    mutex_t queue_mutex;
 } cond_t;
 
 #endif /* _COND_TYPE_H */
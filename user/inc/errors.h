@@ -12,5 +12,6 @@
 #define ERR_INVAL -1
 #define ERR_BUSY -2
 #define ERR_NOMEM -3
+#define ERR_CLOSED -4
 
 #endif /* __THREAD_ERRORS_H */
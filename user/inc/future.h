@@ -0,0 +1,25 @@
+/** @file future.h
+ *  @brief This file defines the interface for futures.
+ *
+ *  A future holds the result of a function run asynchronously on one
+ *  of the library's pooled worker threads. Futures are allocated by
+ *  async() and future_then() and must be released with future_destroy()
+ *  once they are ready.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _FUTURE_H
+#define _FUTURE_H
+
+typedef struct future future_t;
+
+future_t *async(void *(*fn)(void *), void *arg);
+void *future_get(future_t *f);
+int future_try_get(future_t *f, void **valuep);
+future_t *future_then(future_t *f, void *(*fn)(void *));
+int future_wait_any(future_t **futures, int n);
+void future_destroy(future_t *f);
+
+#endif /* _FUTURE_H */
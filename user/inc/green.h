@@ -0,0 +1,29 @@
+/** @file green.h
+ *  @brief This file defines the interface for green threads.
+ *
+ *  Green threads are scheduled cooperatively by the library on a small
+ *  number of kernel threads, so they cost a stack and a few words of
+ *  bookkeeping instead of a kernel thread each. They may use mutexes,
+ *  cond vars, semaphores and rwlocks; blocking on those only parks the
+ *  green thread. Blocking system calls (sleep, readline, ...) block the
+ *  whole kernel thread along with every green thread queued on it.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _GREEN_H
+#define _GREEN_H
+
+#define GREEN_STACK_MAX (1 << 24)    /* Largest stack_size for green_init */
+
+typedef struct green_thread green_t;
+
+int green_init(int nkthreads, unsigned int stack_size);
+green_t *green_create(void *(*func)(void *), void *arg);
+int green_join(green_t *g, void **statusp);
+void green_yield(void);
+void green_exit(void *status);
+void green_shutdown(void);
+
+#endif /* _GREEN_H */
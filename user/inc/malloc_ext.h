@@ -0,0 +1,70 @@
+/** @file malloc_ext.h
+ *  @brief This file defines the malloc interface beyond malloc.h:
+ *         aligned allocation, tuning the heap and giving memory back to
+ *         the kernel.
+ *
+ *  malloc only promises 8 byte alignment. memalign and posix_memalign
+ *  take any power of 2, such as CACHE_LINE_SIZE to keep data written by
+ *  different threads off each other's cache lines.
+ *
+ *  The heap is committed in chunks which double in size, up to a cap,
+ *  so a program which allocates a lot makes few new_pages calls. Memory
+ *  freed at the end of the heap stays committed until malloc_trim is
+ *  called.
+ *
+ *  mallinfo reports counters the allocator keeps up to date, so it is
+ *  cheap enough to call often. Blocks held in the caches of threads
+ *  count as in use.
+ *
+ *  Between malloc_trace_start and malloc_trace_stop every allocation,
+ *  resize and free is logged with lprintf as a line of a 15-213 malloc
+ *  driver trace, after "mtrace: ". The trace ends with a line
+ *  "mtrace: end <heap size> <ids> <ops> <weight>". A trace file for
+ *  malloc_bench is those four numbers, one per line, followed by the
+ *  other lines without their prefix.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _MALLOC_EXT_H
+#define _MALLOC_EXT_H
+
+#include <types.h>
+
+#define CACHE_LINE_SIZE 64
+#define MALLINFO_CLASSES 54     /* Free list classes of the heap */
+
+/** @brief statistics of the heap, sizes are in bytes and include the
+ *         header and footer of each block */
+struct mallinfo {
+    size_t arena;               /* In heap blocks */
+    size_t ordblks;             /* Free heap blocks */
+    size_t hblks;               /* Blocks with pages of their own */
+    size_t hblkhd;              /* In blocks with pages of their own */
+    size_t uordblks;            /* In allocated heap blocks */
+    size_t fordblks;            /* In free heap blocks */
+    size_t largest;             /* Largest free heap block */
+    size_t peak;                /* Most ever in allocated blocks */
+    int fragmentation;          /* Percent of the free bytes which are not
+                                   in the largest free block */
+    size_t classes[MALLINFO_CLASSES];   /* Free heap blocks per class, the
+                                           first 31 hold one size each,
+                                           from 16 bytes up in steps of
+                                           8, the rest one power of 2
+                                           each */
+};
+
+void *memalign(size_t align, size_t size);
+int posix_memalign(void **memptr, size_t align, size_t size);
+
+void malloc_policy(size_t grow_max);
+int malloc_trim(size_t pad);
+
+struct mallinfo mallinfo(void);
+void malloc_stats(void);
+
+void malloc_trace_start(void);
+void malloc_trace_stop(void);
+
+#endif /* _MALLOC_EXT_H */
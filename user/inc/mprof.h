@@ -0,0 +1,35 @@
+/** @file mprof.h
+ *  @brief This file defines the interface of the malloc profiler.
+ *
+ *  The profiler attributes allocations to the address malloc, calloc,
+ *  realloc, memalign or posix_memalign was called from. It samples one
+ *  allocation about every sample_bytes bytes allocated, and counts each
+ *  sample as sample_bytes, or its own size if larger, so the figures of a
+ *  call site are estimates unless sample_bytes is 1. Sampled blocks are
+ *  followed until they are freed, which gives the live bytes of each call
+ *  site.
+ *
+ *  The profiler is on whenever mprof_rate is not 0, so it can also be
+ *  turned on by setting mprof_rate from the debugger, and the report
+ *  logged by calling malloc_profile_dump from there, without rebuilding
+ *  the program.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _MPROF_H
+#define _MPROF_H
+
+#define MPROF_SITES 256     /* Call sites the profiler can tell apart */
+#define MPROF_SAMPLES 4096  /* Sampled blocks it can follow at once */
+#define MPROF_DEFAULT_RATE (64 * 1024)  /* Bytes between samples */
+
+extern unsigned int mprof_rate;
+
+void malloc_profile_start(unsigned int sample_bytes);
+void malloc_profile_stop(void);
+void malloc_profile_reset(void);
+void malloc_profile_dump(int n);
+
+#endif /* _MPROF_H */
@@ -7,14 +7,16 @@
 
 #ifndef _MUTEX_TYPE_H
 #define _MUTEX_TYPE_H
-#include <list.h>
 
-#define MUTEX_VALID 1
-#define MUTEX_INVALID 0
+#define MUTEX_UNLOCKED 0
+#define MUTEX_LOCKED 1      /* Locked, nobody parked on it */
+#define MUTEX_CONTENDED 2   /* Locked, threads may be parked on it */
+
+/* Static initializer, a mutex set to it needs no mutex_init */
+#define MUTEX_INITIALIZER { MUTEX_UNLOCKED }
 
 typedef struct mutex {
-    int value;          /* Will be 0 or 1 */
-    list_head waiting;  /* List of processes waiting for lock */
+    int value;
 } mutex_t;
 
 #endif /* _MUTEX_TYPE_H */
@@ -0,0 +1,24 @@
+/** @file once.h
+ *  @brief This file defines the type and interface for one-time
+ *         initialization.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _ONCE_H
+#define _ONCE_H
+
+#define ONCE_NEW 0
+#define ONCE_RUNNING 1
+#define ONCE_DONE 2
+
+typedef struct once {
+    int state;
+} once_t;
+
+#define ONCE_INIT { ONCE_NEW }
+
+void thr_once(once_t *once, void (*fn)(void));
+
+#endif /* _ONCE_H */
@@ -0,0 +1,35 @@
+/** @file parallel.h
+ *  @brief This file defines the interface for parallel loops.
+ *
+ *  The iteration space [lo, hi) is cut into chunks of at least grain
+ *  iterations which are handed to the calling thread and the workers of
+ *  the thread pool. A body is always called on a whole chunk [lo, hi).
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+/* Chunk scheduling policies */
+#define PARALLEL_STATIC 0   /* Chunks are dealt round robin up front */
+#define PARALLEL_DYNAMIC 1  /* Chunks of grain are claimed from a counter */
+#define PARALLEL_GUIDED 2   /* Claimed chunks shrink as the loop drains */
+
+int parallel_for(int lo, int hi, int grain,
+                 void (*body)(int lo, int hi, void *ctx), void *ctx);
+int parallel_for_sched(int lo, int hi, int grain,
+                       void (*body)(int lo, int hi, void *ctx), void *ctx,
+                       int sched);
+
+void *parallel_reduce(int lo, int hi, int grain,
+                      void *(*body)(int lo, int hi, void *ctx),
+                      void *(*combine)(void *a, void *b, void *ctx),
+                      void *identity, void *ctx);
+void *parallel_reduce_sched(int lo, int hi, int grain,
+                            void *(*body)(int lo, int hi, void *ctx),
+                            void *(*combine)(void *a, void *b, void *ctx),
+                            void *identity, void *ctx, int sched);
+
+#endif /* _PARALLEL_H */
@@ -0,0 +1,21 @@
+/** @file park.h
+ *  @brief This file defines the interface for parking threads on addresses.
+ *
+ *  A thread parks on the address of a word as long as the word holds the
+ *  value it expects, and sleeps until another thread unparks that address.
+ *  Nothing has to be allocated or initialized per address, so any word can
+ *  be waited on. The synchronization primitives of the library are built
+ *  on top of this.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _PARK_H
+#define _PARK_H
+
+int thr_park(int *addr, int expected);
+int thr_unpark_one(int *addr);
+int thr_unpark_all(int *addr);
+
+#endif /* _PARK_H */
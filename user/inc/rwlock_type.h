@@ -7,16 +7,15 @@
 
 #ifndef _RWLOCK_TYPE_H
 #define _RWLOCK_TYPE_H
-#include <cond.h>
-#include <mutex.h>
+
+/* Layout of the state word of a rwlock */
+#define RWLOCK_READERS_MASK 0x0000ffff  /* Readers holding the lock */
+#define RWLOCK_WRITER 0x00010000        /* Set while a writer holds it */
+#define RWLOCK_WRITER_WAITING 0x00020000 /* One writer waiting for it */
+#define RWLOCK_WAITING_MASK 0x7ffe0000
 
 typedef struct rwlock {
-    mutex_t mutex;
-    cond_t readers;
-    cond_t writers;
-    int type;
-    int num_writers;
-    int curr_readers;
+    int state;
 } rwlock_t;
 
 #endif /* _RWLOCK_TYPE_H */
@@ -5,14 +5,9 @@
 #ifndef _SEM_TYPE_H
 #define _SEM_TYPE_H
 
-#include <cond.h>
-#include <mutex.h>
-
 typedef struct sem {
-	mutex_t mutex;
-	cond_t cond_var;
 	int count;
-	int valid;
+	int waiters;    /* Threads parked on count */
 } sem_t;
 
 #endif /* _SEM_TYPE_H */
@@ -0,0 +1,57 @@
+/** @file slab.h
+ *  @brief This file defines the type and interface for object caches.
+ *
+ *  An object cache hands out objects of one size, carved from page sized
+ *  slabs, with no header per object. The constructor of a cache is run
+ *  on every object once, when its slab is allocated, so objects must be
+ *  freed back to the cache in their constructed state. The first word of
+ *  a free object links it into the cache, so the constructor should leave
+ *  that word to the caller.
+ *
+ *  Objects are 8 byte aligned. A cache made with kmem_cache_init_aligned
+ *  aligns them to any power of 2 up to PAGE_SIZE, such as CACHE_LINE_SIZE
+ *  so that no two objects share a cache line.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include <mutex.h>
+
+#define KMEM_SLAB_SIZE 4096     /* PAGE_SIZE */
+
+typedef struct kmem_cache {
+    unsigned int size;          /* Object size, at least a pointer and a
+                                   multiple of align */
+    unsigned int align;         /* Object alignment, a power of 2 */
+    void (*ctor)(void *);       /* May be NULL */
+    void *free;                 /* Free objects, linked through their
+                                   first word */
+    void *slabs;                /* Slabs, linked through their first word */
+    int created;                /* From kmem_cache_create, freed by
+                                   kmem_cache_destroy */
+    mutex_t lock;
+} kmem_cache_t;
+
+/** @brief static initializer, a cache set to it needs no kmem_cache_init */
+#define KMEM_CACHE_INITIALIZER(size, ctor) \
+    KMEM_CACHE_ALIGNED_INITIALIZER(size, 8, ctor)
+#define KMEM_CACHE_ALIGNED_INITIALIZER(size, align, ctor) \
+    { KMEM_OBJ_SIZE(size, align), (align), (ctor), NULL, NULL, 0, \
+      MUTEX_INITIALIZER }
+
+#define KMEM_OBJ_SIZE(size, align) (((size) + (align) - 1) & ~((align) - 1))
+
+int kmem_cache_init(kmem_cache_t *cache, unsigned int size,
+                    void (*ctor)(void *));
+int kmem_cache_init_aligned(kmem_cache_t *cache, unsigned int size,
+                            unsigned int align, void (*ctor)(void *));
+kmem_cache_t *kmem_cache_create(unsigned int size, void (*ctor)(void *));
+void *kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+void kmem_cache_destroy(kmem_cache_t *cache);
+
+#endif /* _SLAB_H */
@@ -0,0 +1,48 @@
+/** @file spsc.h
+ *  @brief This file defines the type and interface for single producer,
+ *         single consumer rings.
+ *
+ *  Exactly one thread may push to a ring and exactly one thread may pop
+ *  from it. Pushes and pops never wait on each other. In blocking mode the
+ *  consumer can also wait for the ring to become non-empty.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _SPSC_H
+#define _SPSC_H
+
+#define SPSC_CACHE_LINE 64
+
+#define SPSC_BLOCKING 1     /* Allow the consumer to park in spsc_pop_wait */
+
+struct green_thread;
+
+typedef struct spsc {
+    /* Written by the producer only */
+    unsigned int tail;          /* Next position to push to */
+    unsigned int head_cache;    /* Last head the producer saw */
+    char prod_pad[SPSC_CACHE_LINE - 2 * sizeof(unsigned int)];
+    /* Written by the consumer only */
+    unsigned int head;          /* Next position to pop from */
+    unsigned int tail_cache;    /* Last tail the consumer saw */
+    char cons_pad[SPSC_CACHE_LINE - 2 * sizeof(unsigned int)];
+    unsigned int mask;          /* Capacity - 1, capacity is a power of 2 */
+    int elem_size;
+    char *buf;
+    int blocking;
+    int waiter;                 /* tid of the parked consumer, 0 if none */
+    int reject;                 /* deschedule flag of the consumer */
+    struct green_thread *green;
+} spsc_t;
+
+int spsc_init(spsc_t *q, int capacity, int elem_size, int flags);
+int spsc_push(spsc_t *q, const void *item);
+int spsc_pop(spsc_t *q, void *item);
+int spsc_push_bulk(spsc_t *q, const void *items, int n);
+int spsc_pop_bulk(spsc_t *q, void *items, int n);
+int spsc_pop_wait(spsc_t *q, void *items, int n);
+void spsc_destroy(spsc_t *q);
+
+#endif /* _SPSC_H */
@@ -0,0 +1,22 @@
+/** @file stackmon.h
+ *  @brief This file defines the interface for measuring stack usage.
+ *
+ *  Once painting is turned on, every page committed to a stack is filled
+ *  with STACK_CANARY. The usage of a stack is then how far from its top
+ *  the canary has been overwritten. Stacks, or parts of them, which were
+ *  committed before painting was turned on count as fully used.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _STACKMON_H
+#define _STACKMON_H
+
+#define STACK_CANARY 0x5a5a5a5a
+
+void thr_stack_paint(int enable);
+int thr_stack_usage(int tid);
+void thr_stack_report(void);
+
+#endif /* _STACKMON_H */
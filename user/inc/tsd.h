@@ -0,0 +1,23 @@
+/** @file tsd.h
+ *  @brief This file defines the interface for thread specific data.
+ *
+ *  A key names one pointer sized slot in every thread. A thread only ever
+ *  sees its own slot. When a thread exits, the destructor of each key
+ *  whose slot is not NULL is called with the value of the slot. Green
+ *  threads share the slots of the kernel thread they run on.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef _TSD_H
+#define _TSD_H
+
+#define THR_KEYS_MAX 32
+#define THR_DESTRUCTOR_ITERATIONS 4 /* Passes over the keys at exit */
+
+int thr_key_create(void (*destructor)(void *));
+int thr_setspecific(int key, void *value);
+void *thr_getspecific(int key);
+
+#endif /* _TSD_H */
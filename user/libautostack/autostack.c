@@ -1,6 +1,27 @@
 /** @file autostack.c
  *  @brief Grow the stack
  *
+ *  Every stack is an autostack_t: a range of addresses reserved for it of
+ *  which only the top is backed by pages at first. A page fault below the
+ *  committed part makes the swexn handler of the thread commit more of the
+ *  range. Every commit at least doubles the committed size, up to a cap
+ *  of autostack_grow_max bytes, so a thread takes few faults and its stack
+ *  few chunks to keep track of. A stack also remembers the deepest it has
+ *  ever been committed, and grows straight back there when it faults.
+ *  A stack is trimmed by giving back the chunks wholly below the stack
+ *  pointer, less AUTOSTACK_TRIM_SLACK, either when asked to or, if
+ *  autostack_trim_ticks is set, at most that often as threads block.
+ *  If autostack_paint is set new chunks are painted with STACK_CANARY, so
+ *  that autostack_usage can tell how much of a stack was really used.
+ *  Another thread may be scanning a stack while its owner trims it, so
+ *  chunks are given back and stacks scanned with the lock of the stack
+ *  held. Growing needs no lock, the new chunk is backed before it shows.
+ *
+ *  The main thread's stack is main_stack. Its range reaches down to the
+ *  heap until the thread library places the stacks of other threads below
+ *  it. Their swexn handlers run on the very top of their range, which is
+ *  never given back while the thread lives.
+ *
  *  @author Rohit Upadhyaya (rjupadhy)
  *  @author Prajwal Yadapadithaya (pyadapad)
  */
@@ -10,10 +31,20 @@
 #include <simics.h>
 #include <asm.h>
 #include <panic.h>
+#include <errors.h>
+#include <autostack.h>
+#include <stackmon.h>
 
-#define EXCEPTION_STACK_SIZE 1024
-void *stack_bottom;
+autostack_t main_stack;
 void *exception_stack;
+unsigned int autostack_grow_max = AUTOSTACK_GROW_MAX;
+int autostack_paint = 0;    /* Fill committed pages with STACK_CANARY */
+unsigned int autostack_trim_ticks = 0;  /* Period of trims, 0 for none */
+autostack_t *(*autostack_locate)(void);  /* Stack of the calling thread, if
+                                            it is not the main thread */
+
+static void stack_lock(autostack_t *as);
+static void stack_unlock(autostack_t *as);
 
 /** @brief software exception handler
  *  
@@ -31,11 +62,9 @@ void *exception_stack;
  */
 void seh(void *arg, ureg_t *ureg) {
     if (ureg->cause == SWEXN_CAUSE_PAGEFAULT) {
-        int ret = new_pages(stack_bottom - PAGE_SIZE, PAGE_SIZE);
-        if (ret < 0) {
+        if (autostack_commit(&main_stack, (char *)ureg->cr2) < 0) {
             die("Stack overflow error!");
         }
-        stack_bottom -= PAGE_SIZE;
         swexn((char *)exception_stack + EXCEPTION_STACK_SIZE, 
               seh, NULL, ureg);
     }
@@ -44,7 +73,8 @@ void seh(void *arg, ureg_t *ureg) {
 /** @brief install the auto stack growing handler
  *  
  *  Called by the main wrapper before our program's main is called.
- *  Initializes the exception stack where the software exception handler will
+ *  Commits AUTOSTACK_PREFAULT bytes of stack right away, initializes the
+ *  exception stack where the software exception handler will
  *  run and makes a call to swexn to install the handler. If we are unable to
  *  malloc enough space for the exception handler, we simply return from the 
  *  function without installing the exception handler. In case a page fault 
@@ -58,7 +88,13 @@ void seh(void *arg, ureg_t *ureg) {
  *  @return void
  */
 void install_autostack(void *stack_high, void *stack_low) {
-    stack_bottom = stack_low;
+    main_stack.high = stack_high;
+    main_stack.low = stack_low;
+    main_stack.peak = stack_low;
+    main_stack.floor = stack_low;
+    main_stack.limit = (char *)PAGE_SIZE;   /* Until thr_init */
+    main_stack.nchunks = 0;
+    autostack_commit(&main_stack, main_stack.high - AUTOSTACK_PREFAULT);
     exception_stack = malloc(EXCEPTION_STACK_SIZE);
     if (exception_stack == NULL) {
         return;
@@ -67,6 +103,25 @@ void install_autostack(void *stack_high, void *stack_low) {
           seh, NULL, 0);
 }
 
+/** @brief set the growth policy of stacks
+ *
+ *  @param grow_max the most a stack grows by at a time, once it is at
+ *         least that large, 0 to keep the current cap
+ *  @param reserve how much of the main thread's stack to commit now
+ *
+ *  @return 0 on success, negative error code if the reserve could not be
+ *          committed
+ */
+int autostack_policy(unsigned int grow_max, unsigned int reserve) {
+    if (grow_max != 0) {
+        autostack_grow_max = (grow_max + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    }
+    if (reserve > (unsigned int)(main_stack.high - main_stack.limit)) {
+        return ERR_INVAL;
+    }
+    return autostack_commit(&main_stack, main_stack.high - reserve);
+}
+
 /** @brief deregister the swexn handler
  *  
  *  Deregister by calling the swexn system call without parameters.
@@ -79,28 +134,226 @@ void uninstall_seh() {
 
 /** @brief the exception handler for the multi threaded scenario
  *  
- *  panic and kill the program.
+ *  Page faults in the reserved but uncommitted part of the thread's stack
+ *  are handled by committing more of it. On any other exception, or if
+ *  the stack can not grow, we panic and kill the program.
+ *
+ *  @param arg the autostack_t of the faulting thread
+ *  @param ureg the current values of the register set
  *
  *  @return void
  */
 void seh_multi(void *arg, ureg_t *ureg) {
-    die("Thread caused a segmentation fault.");
+    autostack_t *as = (autostack_t *)arg;
+    char *addr = (char *)ureg->cr2;
+
+    if (ureg->cause != SWEXN_CAUSE_PAGEFAULT || addr >= as->low) {
+        die("Thread caused a segmentation fault.");
+    }
+    if (addr < as->limit || autostack_commit(as, addr) < 0) {
+        die("Stack overflow error!");
+    }
+    swexn(as->exception_stack + EXCEPTION_STACK_SIZE, seh_multi, as, ureg);
 }
 
 /** @brief install the exception handler for the multi threaded scenario
  *  
- *  called for each thread which is created. If malloc fails we return and
- *  hope that no thread overflows the stack. If it does then we rely on the
- *  default kernel exception handler to crash the program.
+ *  called for each thread which is created, on the stack described by as.
+ *  The exception stack is part of the thread's stack, so nothing needs to
+ *  be allocated here.
+ *
+ *  @param as the stack of the calling thread
  *
  *  @return void
  */
-void install_seh_multi() {
-    exception_stack = malloc(EXCEPTION_STACK_SIZE);
-    if (exception_stack == NULL) {
+void install_seh_multi(autostack_t *as) {
+    if (as == NULL) {
         return;
     }
-    swexn((char *)exception_stack + EXCEPTION_STACK_SIZE, 
-          seh_multi, NULL, 0);
+    swexn(as->exception_stack + EXCEPTION_STACK_SIZE, seh_multi, as, 0);
+}
+
+/** @brief commit the stack down to the page holding addr
+ *
+ *  The new chunk goes down to the deepest the stack has ever been, or is
+ *  as large as what is committed already, whichever is more. While the
+ *  stack has used fewer than half of its chunks the growth is capped by
+ *  autostack_grow_max, after that it keeps doubling so that it can not run
+ *  out of chunks. The chunk never goes below the limit of the stack. If
+ *  there is not enough memory for all of it we settle for the page holding
+ *  addr.
+ *
+ *  @param as the stack
+ *  @param addr the address which must be backed by a page
+ *
+ *  @return 0 on success, negative error code on failure
+ */
+int autostack_commit(autostack_t *as, char *addr) {
+    char *need = (char *)((unsigned int)addr & ~(PAGE_SIZE - 1));
+    unsigned int grow = as->high - as->low;
+    char *base;
+    int ret;
+
+    if (need >= as->low) {
+        return 0;
+    }
+    if (need < as->limit || as->nchunks == AUTOSTACK_MAX_CHUNKS) {
+        return ERR_NOMEM;
+    }
+    if (as->nchunks < AUTOSTACK_MAX_CHUNKS / 2 && grow > autostack_grow_max) {
+        grow = autostack_grow_max;
+    }
+    grow &= ~(PAGE_SIZE - 1);
+    base = (grow > (unsigned int)(as->low - as->limit)) ?
+           as->limit : as->low - grow;
+    if (as->peak < base) {
+        base = as->peak;
+    }
+    if (need < base) {
+        base = need;
+    }
+    if ((ret = new_pages(base, as->low - base)) < 0) {
+        if (base == need || (ret = new_pages(need, as->low - need)) < 0) {
+            return ret;
+        }
+        base = need;
+    }
+    if (autostack_paint) {
+        unsigned int *word;
+        for (word = (unsigned int *)base; word < (unsigned int *)as->low;
+             word++) {
+            *word = STACK_CANARY;
+        }
+    }
+    as->chunks[as->nchunks++] = base;
+    as->low = base;
+    if (base < as->peak) {
+        as->peak = base;
+    }
+    return 0;
+}
+
+/** @brief give back all pages committed to a stack
+ *
+ *  @param as the stack, which no thread may be running on
+ *
+ *  @return void
+ */
+void autostack_release(autostack_t *as) {
+    stack_lock(as);
+    as->low = as->high;
+    while (as->nchunks > 0) {
+        remove_pages(as->chunks[--as->nchunks]);
+    }
+    stack_unlock(as);
+}
+
+/** @brief find how much of a stack has been used
+ *
+ *  Scans up from the lowest committed address for the first word which
+ *  does not hold the canary.
+ *
+ *  @param as the stack, which may belong to another thread
+ *
+ *  @return the bytes used below the start of the stack
+ */
+unsigned int autostack_usage(autostack_t *as) {
+    char *top = (as->exception_stack != NULL) ? as->exception_stack : as->high;
+    unsigned int *word;
+
+    stack_lock(as);
+    word = (unsigned int *)as->low;
+    while ((char *)word < top && *word == STACK_CANARY) {
+        word++;
+    }
+    stack_unlock(as);
+    return top - (char *)word;
+}
+
+/** @brief give back the chunks of the calling thread's stack which are
+ *         wholly below the stack pointer less AUTOSTACK_TRIM_SLACK
+ *
+ *  As remove_pages gives back whole chunks, a chunk of which some part is
+ *  in use is kept in full. The high-water mark of the stack moves halfway
+ *  back to what is still committed, so that a thread which rarely runs
+ *  deep stops growing straight back there.
+ *
+ *  @return the number of bytes given back
+ */
+int autostack_trim(void) {
+    autostack_t *as = (autostack_locate != NULL) ? autostack_locate() : NULL;
+    char *sp = (char *)&as;
+    char *top, *old_low;
+
+    if (as == NULL) {
+        as = &main_stack;
+    }
+    if (sp < as->low || sp >= as->high || sp - as->low < AUTOSTACK_TRIM_SLACK) {
+        return 0;       /* Not on this stack, or nothing to give back */
+    }
+    sp -= AUTOSTACK_TRIM_SLACK;
+    stack_lock(as);
+    old_low = as->low;
+    while (as->nchunks > 0) {
+        top = (as->nchunks > 1) ? as->chunks[as->nchunks - 2] : as->floor;
+        if (top > sp) {
+            break;
+        }
+        as->low = top;
+        remove_pages(as->chunks[--as->nchunks]);
+    }
+    as->peak += ((as->low - as->peak) / 2) & ~(PAGE_SIZE - 1);
+    stack_unlock(as);
+    return as->low - old_low;
+}
+
+/** @brief trim the stack of the calling thread if a period has passed
+ *         since the last trim
+ *
+ *  Called by the thread library when a kernel thread is about to block,
+ *  never for a green thread, whose stack is not an autostack.
+ *
+ *  @return void
+ */
+void autostack_maybe_trim(void) {
+    autostack_t *as;
+    unsigned int now;
+
+    if (autostack_trim_ticks == 0) {
+        return;
+    }
+    as = (autostack_locate != NULL) ? autostack_locate() : NULL;
+    if (as == NULL) {
+        as = &main_stack;
+    }
+    now = get_ticks();
+    if (now - as->trimmed_at >= autostack_trim_ticks) {
+        as->trimmed_at = now;
+        autostack_trim();
+    }
+}
+
+/** @brief take the lock of a stack
+ *
+ *  A spin lock, since the thread library may not be initialized. It is
+ *  only held for a scan or a few remove_pages calls.
+ *
+ *  @param as the stack
+ *
+ *  @return void
+ */
+static void stack_lock(autostack_t *as) {
+    while (test_and_set(&as->lock)) {
+        yield(-1);
+    }
+}
+
+/** @brief release the lock of a stack
+ *
+ *  @param as the stack
+ *
+ *  @return void
+ */
+static void stack_unlock(autostack_t *as) {
+    test_and_unset(&as->lock);
 }
-    
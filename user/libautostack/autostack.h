@@ -6,7 +6,54 @@
 #ifndef __AUTOSTACK_H
 #define __AUTOSTACK_H
 
+#define EXCEPTION_STACK_SIZE 1024
+#define AUTOSTACK_MAX_CHUNKS 32
+#define AUTOSTACK_GROW_MAX (1024 * 1024)    /* Default cap on one growth */
+#define AUTOSTACK_PREFAULT (64 * 1024)      /* Main stack committed at start */
+#define AUTOSTACK_TRIM_SLACK (64 * 1024)    /* Kept below the stack pointer */
+#define AUTOSTACK_MAIN_RESERVE (16 * 1024 * 1024)   /* Most the main stack
+                                                       may grow to */
+
+/** @brief a lazily committed thread stack
+ *
+ *  The stack may grow down from high to limit. Only [low, high) is backed
+ *  by pages, which were committed in chunks, each with its own new_pages
+ *  call so that it can be given back with remove_pages. The pages the
+ *  kernel gave the main thread to start with are not a chunk, they are
+ *  [floor, high).
+ */
+typedef struct autostack {
+    char *high;                 /* One past the highest address */
+    char *low;                  /* Lowest committed address */
+    char *limit;                /* Lowest address the stack may grow to */
+    char *peak;                 /* Lowest address ever committed, moves back
+                                   up as the stack is trimmed */
+    char *floor;                /* Top of the highest chunk */
+    unsigned int trimmed_at;    /* Ticks at the last periodic trim */
+    int lock;                   /* Held while chunks are given back or the
+                                   stack is scanned, 0 when free */
+    int nchunks;
+    char *chunks[AUTOSTACK_MAX_CHUNKS];     /* Chunk bases, lowest last */
+    char *exception_stack;      /* Base of the swexn handler's stack, the
+                                   top EXCEPTION_STACK_SIZE bytes of the
+                                   range, and also the initial stack
+                                   pointer of the thread, NULL for the
+                                   main thread */
+} autostack_t;
+
+extern autostack_t main_stack;
+extern unsigned int autostack_grow_max;
+extern int autostack_paint;
+extern unsigned int autostack_trim_ticks;
+extern autostack_t *(*autostack_locate)(void);
+
+int autostack_policy(unsigned int grow_max, unsigned int reserve);
 void uninstall_seh();
-void install_seh_multi();
+void install_seh_multi(autostack_t *as);
+int autostack_commit(autostack_t *as, char *addr);
+void autostack_release(autostack_t *as);
+unsigned int autostack_usage(autostack_t *as);
+int autostack_trim(void);
+void autostack_maybe_trim(void);
 
 #endif  /* __AUTOSTACK_H */
@@ -0,0 +1,127 @@
+/** @file arena.c
+ *  @brief Implementation of arenas
+ *
+ *  Chunks are pages mapped with page_alloc, so destroying an arena gives
+ *  its memory back to the kernel. The arena_t itself sits at the start of
+ *  the first chunk, which is kept by arena_reset. Every other chunk starts
+ *  with ARENA_ALIGN bytes linking it into the list of chunks. A request
+ *  too large for a chunk gets a chunk of its own, and allocation goes on
+ *  in the chunk it was in.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <arena.h>
+#include <syscall.h>
+#include <stddef.h>
+#include <limits.h>
+#include <thr_internals.h>
+
+#define ROUND_UP(n, to) (((n) + (to) - 1) & ~((to) - 1))
+#define ARENA_HEADER ROUND_UP(sizeof(arena_t), ARENA_ALIGN)
+/* Largest size which can be rounded up without wrapping around */
+#define ARENA_MAX_SIZE (UINT_MAX - ARENA_ALIGN - PAGE_SIZE)
+
+static char *chunk_alloc(arena_t *arena, unsigned int len);
+
+/** @brief create an arena
+ *
+ *  @param chunk_size size of the chunks the arena allocates from, rounded
+ *         up to pages, 0 for ARENA_CHUNK_SIZE
+ *  @return the arena, NULL if out of memory or chunk_size is too large
+ */
+arena_t *arena_create(unsigned int chunk_size) {
+    arena_t *arena;
+
+    if (chunk_size == 0) {
+        chunk_size = ARENA_CHUNK_SIZE;
+    }
+    if (chunk_size > ARENA_MAX_SIZE) {
+        return NULL;
+    }
+    chunk_size = ROUND_UP(chunk_size, PAGE_SIZE);
+    if ((arena = page_alloc(chunk_size)) == NULL) {
+        return NULL;
+    }
+    arena->chunk_size = chunk_size;
+    arena->chunks = NULL;
+    arena->next = (char *)arena + ARENA_HEADER;
+    arena->end = (char *)arena + chunk_size;
+    return arena;
+}
+
+/** @brief allocate from an arena
+ *
+ *  @param arena the arena
+ *  @param size the number of bytes
+ *  @return memory aligned to ARENA_ALIGN, NULL if size is 0 or too large
+ *          or we are out of memory
+ */
+void *arena_alloc(arena_t *arena, unsigned int size) {
+    char *chunk;
+    void *mem;
+
+    if (size == 0 || size > ARENA_MAX_SIZE) {
+        return NULL;
+    }
+    size = ROUND_UP(size, ARENA_ALIGN);
+    if (size <= (unsigned int)(arena->end - arena->next)) {
+        mem = arena->next;
+        arena->next += size;
+        return mem;
+    }
+    if (size > arena->chunk_size - ARENA_ALIGN) {
+        chunk = chunk_alloc(arena, ROUND_UP(size + ARENA_ALIGN, PAGE_SIZE));
+        return (chunk == NULL) ? NULL : chunk + ARENA_ALIGN;
+    }
+    if ((chunk = chunk_alloc(arena, arena->chunk_size)) == NULL) {
+        return NULL;
+    }
+    arena->next = chunk + ARENA_ALIGN + size;
+    arena->end = chunk + arena->chunk_size;
+    return chunk + ARENA_ALIGN;
+}
+
+/** @brief free everything allocated from an arena
+ *
+ *  All chunks but the first are given back.
+ *
+ *  @param arena the arena
+ *  @return void
+ */
+void arena_reset(arena_t *arena) {
+    void *chunk;
+
+    while ((chunk = arena->chunks) != NULL) {
+        arena->chunks = *(void **)chunk;
+        page_free(chunk);
+    }
+    arena->next = (char *)arena + ARENA_HEADER;
+    arena->end = (char *)arena + arena->chunk_size;
+}
+
+/** @brief free everything allocated from an arena, and the arena
+ *
+ *  @param arena the arena
+ *  @return void
+ */
+void arena_destroy(arena_t *arena) {
+    arena_reset(arena);
+    page_free(arena);
+}
+
+/** @brief map a chunk and link it into an arena
+ *
+ *  @param arena the arena
+ *  @param len the size of the chunk, a multiple of PAGE_SIZE
+ *  @return the chunk, NULL if out of memory
+ */
+static char *chunk_alloc(arena_t *arena, unsigned int len) {
+    char *chunk = page_alloc(len);
+
+    if (chunk != NULL) {
+        *(void **)chunk = arena->chunks;
+        arena->chunks = chunk;
+    }
+    return chunk;
+}
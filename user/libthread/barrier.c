@@ -0,0 +1,262 @@
+/** @file barrier.c
+ *  @brief Implementation of barriers
+ *
+ *  A barrier is a tree of nodes, each of which a fixed number of threads
+ *  (or child nodes) arrive at. The last thread to arrive at a node goes on
+ *  to the parent, everybody else waits at the node. The thread completing
+ *  the root is the serial thread of the phase. On the way back every
+ *  thread releases the nodes it completed, so the wakeups of a phase are
+ *  spread over the threads instead of being done by the last one to show
+ *  up. The centralized barrier is the same thing with a single node.
+ *
+ *  Nodes are sense reversing: a phase ends when the sense of the node
+ *  flips, so counts never need to be reset by the waiting threads. Since
+ *  a woken thread may arrive at the next phase while its node is still
+ *  waking others, the waiter slots are kept per sense. The leaf a thread
+ *  arrives at depends on its arrival order, so it may also get to a node
+ *  which has not been released from the previous phase yet. All nodes
+ *  have the same sense between phases, so an arriving thread takes the
+ *  sense of the root, which is released first, and lets the release
+ *  catch up with any node still behind it.
+ *
+ *  A waiter publishes its tid in its slot before it checks the sense and
+ *  the releasing thread claims it with a compare and swap before waking
+ *  it up. A waiter that sees the flip first takes its tid back, so it is
+ *  not sent a stray make_runnable. A waiter that finds itself claimed
+ *  stays until its flag is set, so the releasing thread never wakes a
+ *  thread which has left the barrier.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <barrier.h>
+#include <thread.h>
+#include <asm.h>
+#include <syscall.h>
+#include <errors.h>
+#include <malloc.h>
+
+#define TRUE 1
+#define FALSE 0
+
+#define BARRIER_MAX_DEPTH 32
+
+/** @brief a thread waiting at a barrier node */
+typedef struct barrier_waiter {
+    int tid;                    /* 0 when the slot is not claimable */
+    int flag;                   /* deschedule flag */
+    struct green_thread *green;
+} barrier_waiter_t;
+
+/** @brief a node of the combining tree */
+typedef struct barrier_node {
+    int count;                  /* Arrivals still missing in this phase */
+    int fanin;
+    int sense;
+    int parent;                 /* Index of the parent, -1 for the root */
+    barrier_waiter_t *waiters;  /* fanin slots for each sense */
+} barrier_node_t;
+
+static void node_wait(barrier_node_t *node, int sense, int pos);
+static void node_release(barrier_node_t *node);
+
+/** @brief initialize a barrier for n threads
+ *
+ *  Small barriers are centralized, larger ones use a combining tree.
+ *
+ *  @param b the barrier
+ *  @param n number of threads taking part in every phase
+ *  @return 0 on success, negative error code on failure
+ */
+int barrier_init(barrier_t *b, int n) {
+    if (n > BARRIER_TREE_THRESHOLD) {
+        return barrier_init_mode(b, n, BARRIER_TREE);
+    }
+    return barrier_init_mode(b, n, BARRIER_CENTRAL);
+}
+
+/** @brief initialize a barrier for n threads with the given layout
+ *
+ *  @param b the barrier
+ *  @param n number of threads taking part in every phase
+ *  @param mode BARRIER_CENTRAL or BARRIER_TREE
+ *  @return 0 on success, negative error code on failure
+ */
+int barrier_init_mode(barrier_t *b, int n, int mode) {
+    barrier_waiter_t *waiters;
+    int fanin, nnodes, level, first, count, i;
+
+    if (b == NULL || n <= 0 ||
+        (mode != BARRIER_CENTRAL && mode != BARRIER_TREE)) {
+        return ERR_INVAL;
+    }
+    fanin = (mode == BARRIER_TREE && n > BARRIER_FANIN) ? BARRIER_FANIN : n;
+
+    nnodes = 0;
+    level = n;
+    do {
+        level = (level + fanin - 1) / fanin;
+        nnodes += level;
+    } while (level > 1);
+
+    b->nodes = (barrier_node_t *)malloc(nnodes * sizeof(barrier_node_t));
+    waiters = (barrier_waiter_t *)calloc(2 * fanin * nnodes,
+                                         sizeof(barrier_waiter_t));
+    if (b->nodes == NULL || waiters == NULL) {
+        free(b->nodes);
+        free(waiters);
+        return ERR_NOMEM;
+    }
+
+    /* Lay the tree out level by level, leaves first */
+    first = 0;
+    level = n;
+    do {
+        count = (level + fanin - 1) / fanin;
+        for (i = 0; i < count; i++) {
+            barrier_node_t *node = &b->nodes[first + i];
+            node->fanin = (level - i * fanin < fanin) ?
+                          level - i * fanin : fanin;
+            node->count = node->fanin;
+            node->sense = 0;
+            node->parent = (count == 1) ? -1 : first + count + i / fanin;
+            node->waiters = &waiters[2 * fanin * (first + i)];
+        }
+        first += count;
+        level = count;
+    } while (count > 1);
+
+    b->n = n;
+    b->ticket = 0;
+    b->fanin = fanin;
+    b->nnodes = nnodes;
+    return 0;
+}
+
+/** @brief wait until all threads of the barrier have arrived
+ *
+ *  @param b the barrier
+ *  @return BARRIER_SERIAL_THREAD for one thread of every phase, 0 for the
+ *          others, ERR_INVAL for invalid input
+ */
+int barrier_wait(barrier_t *b) {
+    barrier_node_t *path[BARRIER_MAX_DEPTH];
+    barrier_node_t *node;
+    int depth = 0;
+    int serial = FALSE;
+    int sense, arrived;
+
+    if (b == NULL || b->nodes == NULL) {
+        return ERR_INVAL;
+    }
+
+    /* The arrival number picks the leaf, so every leaf fills up exactly */
+    sense = b->nodes[b->nnodes - 1].sense;
+    node = &b->nodes[atomic_add(&b->ticket, 1) / b->fanin];
+    while (1) {
+        while (node->sense != sense) {
+            if (green_self() != NULL) {
+                green_yield();
+            }
+            else {
+                yield(-1);
+            }
+        }
+        arrived = node->fanin - atomic_add(&node->count, -1) + 1;
+        if (arrived < node->fanin) {
+            node_wait(node, sense, arrived - 1);
+            break;
+        }
+        node->count = node->fanin;
+        path[depth++] = node;
+        if (node->parent < 0) {
+            b->ticket = 0;
+            serial = TRUE;
+            break;
+        }
+        node = &b->nodes[node->parent];
+    }
+
+    /* Release the nodes we completed, top down */
+    while (depth > 0) {
+        node_release(path[--depth]);
+    }
+    return serial ? BARRIER_SERIAL_THREAD : 0;
+}
+
+/** @brief destroy a barrier
+ *
+ *  @pre no thread is waiting at the barrier
+ *  @param b the barrier
+ *  @return void
+ */
+void barrier_destroy(barrier_t *b) {
+    if (b == NULL || b->nodes == NULL) {
+        return;
+    }
+    free(b->nodes[0].waiters);
+    free(b->nodes);
+    b->nodes = NULL;
+}
+
+/** @brief wait at a node until its sense flips
+ *
+ *  @param node the node
+ *  @param sense the sense of the node when we arrived
+ *  @param pos our waiter slot
+ *  @return void
+ */
+static void node_wait(barrier_node_t *node, int sense, int pos) {
+    barrier_waiter_t *w = &node->waiters[sense * node->fanin + pos];
+    int tid = thr_getid();
+
+    w->flag = 0;
+    w->green = green_self();
+    compare_and_swap(&w->tid, 0, tid);  /* Publish before checking sense */
+
+    while (node->sense == sense) {
+        if (w->green != NULL) {
+            green_sleep(w->green, &w->flag);
+        }
+        else {
+            deschedule(&w->flag);
+        }
+    }
+    if (compare_and_swap(&w->tid, tid, 0) == tid) {
+        return;
+    }
+    /* Claimed, the releasing thread is about to set our flag */
+    while (!*(volatile int *)&w->flag) {
+        if (w->green != NULL) {
+            green_sleep(w->green, &w->flag);
+        }
+        else {
+            deschedule(&w->flag);
+        }
+    }
+}
+
+/** @brief end the phase of a node and wake up its waiters
+ *
+ *  @param node the node
+ *  @return void
+ */
+static void node_release(barrier_node_t *node) {
+    int sense = node->sense;
+    int i;
+
+    compare_and_swap(&node->sense, sense, !sense);
+    for (i = 0; i < node->fanin - 1; i++) {
+        barrier_waiter_t *w = &node->waiters[sense * node->fanin + i];
+        int tid = w->tid;
+        if (tid != 0 && compare_and_swap(&w->tid, tid, 0) == tid) {
+            if (w->green != NULL) {
+                green_wakeup(w->green, &w->flag);
+            }
+            else {
+                w->flag = 1;
+                make_runnable(tid);
+            }
+        }
+    }
+}
@@ -0,0 +1,362 @@
+/** @file chan.c
+ *  @brief Implementation of channels
+ *
+ *  The items live in a ring of slots, each tagged with a sequence number
+ *  telling which lap of the ring it is ready for. A slot at position pos
+ *  can be filled when its sequence number is pos and emptied when it is
+ *  pos + 1, so senders and receivers only ever contend on the compare and
+ *  swap that claims positions, never on a lock. A batch claims a run of
+ *  ready slots with a single compare and swap.
+ *
+ *  The mutex and cond vars are only used to park threads on a full or
+ *  empty channel. A parked thread counts itself in the waiters count of
+ *  its side before it takes a last look at the ring, and the other side
+ *  checks that count after it has published its slots, so either the
+ *  parking thread sees the slots or the other side sees it and wakes it.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <chan.h>
+#include <mutex.h>
+#include <cond.h>
+#include <asm.h>
+#include <errors.h>
+#include <malloc.h>
+#include <string.h>
+
+#define SEND_READY 0    /* A slot is free when its sequence number is pos */
+#define RECV_READY 1    /* and holds an item when it is pos + 1 */
+
+#define SLOT_SEQ(c, pos) \
+    (*(volatile unsigned int *)((c)->slots + ((pos) & (c)->mask) * (c)->stride))
+#define SLOT_DATA(c, pos) \
+    ((c)->slots + ((pos) & (c)->mask) * (c)->stride + sizeof(unsigned int))
+
+static int ring_put(chan_t *c, const char *items, int n);
+static int ring_get(chan_t *c, char *items, int n);
+static int ring_claim(chan_t *c, unsigned int *posp, int n, int ready,
+                      unsigned int *startp);
+static void chan_notify(chan_t *c, int *waiters, cond_t *cv, int n);
+
+/** @brief initialize a channel
+ *
+ *  The capacity is rounded up to a power of two.
+ *
+ *  @param c the channel
+ *  @param capacity number of items the channel can hold
+ *  @param elem_size size of an item in bytes
+ *  @return 0 on success, negative error code on failure
+ */
+int chan_init(chan_t *c, int capacity, int elem_size) {
+    unsigned int size = 1;
+    unsigned int i;
+
+    if (c == NULL || capacity <= 0 || elem_size <= 0) {
+        return ERR_INVAL;
+    }
+    while (size < capacity) {
+        size <<= 1;
+    }
+    c->stride = sizeof(unsigned int) + ((elem_size + sizeof(int) - 1) &
+                                        ~(sizeof(int) - 1));
+    c->slots = (char *)malloc(size * c->stride);
+    if (c->slots == NULL) {
+        return ERR_NOMEM;
+    }
+    c->mask = size - 1;
+    c->elem_size = elem_size;
+    for (i = 0; i < size; i++) {
+        SLOT_SEQ(c, i) = i;
+    }
+    c->head = 0;
+    c->tail = 0;
+    c->closed = 0;
+    c->send_waiters = 0;
+    c->recv_waiters = 0;
+    mutex_init(&c->lock);
+    cond_init(&c->not_full);
+    cond_init(&c->not_empty);
+    return 0;
+}
+
+/** @brief send an item, waiting for room if the channel is full
+ *
+ *  @param c the channel
+ *  @param item the item to copy into the channel
+ *  @return 0 on success, ERR_CLOSED if the channel is closed, ERR_INVAL
+ *          for invalid input
+ */
+int chan_send(chan_t *c, const void *item) {
+    int ret = chan_send_batch(c, item, 1);
+    return (ret < 0) ? ret : 0;
+}
+
+/** @brief receive an item, waiting for one if the channel is empty
+ *
+ *  @param c the channel
+ *  @param item where to copy the item to
+ *  @return 0 on success, ERR_CLOSED if the channel is closed and drained,
+ *          ERR_INVAL for invalid input
+ */
+int chan_recv(chan_t *c, void *item) {
+    int ret = chan_recv_batch(c, item, 1);
+    return (ret < 0) ? ret : 0;
+}
+
+/** @brief send an item if the channel has room for it
+ *
+ *  @param c the channel
+ *  @param item the item to copy into the channel
+ *  @return 0 on success, ERR_BUSY if the channel is full, ERR_CLOSED if it
+ *          is closed, ERR_INVAL for invalid input
+ */
+int chan_try_send(chan_t *c, const void *item) {
+    if (c == NULL || c->slots == NULL || item == NULL) {
+        return ERR_INVAL;
+    }
+    if (c->closed) {
+        return ERR_CLOSED;
+    }
+    if (ring_put(c, item, 1) == 0) {
+        return ERR_BUSY;
+    }
+    chan_notify(c, &c->recv_waiters, &c->not_empty, 1);
+    return 0;
+}
+
+/** @brief receive an item if the channel has one
+ *
+ *  @param c the channel
+ *  @param item where to copy the item to
+ *  @return 0 on success, ERR_BUSY if the channel is empty, ERR_CLOSED if
+ *          it is closed and drained, ERR_INVAL for invalid input
+ */
+int chan_try_recv(chan_t *c, void *item) {
+    if (c == NULL || c->slots == NULL || item == NULL) {
+        return ERR_INVAL;
+    }
+    if (ring_get(c, item, 1) == 0) {
+        return c->closed ? ERR_CLOSED : ERR_BUSY;
+    }
+    chan_notify(c, &c->send_waiters, &c->not_full, 1);
+    return 0;
+}
+
+/** @brief send n items, waiting for room whenever the channel is full
+ *
+ *  @param c the channel
+ *  @param items array of n items to copy into the channel
+ *  @param n number of items
+ *  @return number of items sent, which is less than n only if the channel
+ *          got closed, ERR_CLOSED if the channel was closed before any
+ *          item was sent, ERR_INVAL for invalid input
+ */
+int chan_send_batch(chan_t *c, const void *items, int n) {
+    const char *p = (const char *)items;
+    int sent = 0;
+    int k;
+
+    if (c == NULL || c->slots == NULL || items == NULL || n < 0) {
+        return ERR_INVAL;
+    }
+    while (sent < n && !c->closed) {
+        k = ring_put(c, p + sent * c->elem_size, n - sent);
+        if (k == 0) {
+            /* Full, park until a receiver makes room */
+            mutex_lock(&c->lock);
+            atomic_add(&c->send_waiters, 1);
+            while ((k = ring_put(c, p + sent * c->elem_size, n - sent)) == 0 &&
+                   !c->closed) {
+                cond_wait(&c->not_full, &c->lock);
+            }
+            atomic_add(&c->send_waiters, -1);
+            mutex_unlock(&c->lock);
+        }
+        chan_notify(c, &c->recv_waiters, &c->not_empty, k);
+        sent += k;
+    }
+    if (sent == 0 && n > 0) {
+        return ERR_CLOSED;
+    }
+    return sent;
+}
+
+/** @brief receive up to n items, waiting for one if the channel is empty
+ *
+ *  Only waits for the first item, the rest is whatever the channel holds.
+ *
+ *  @param c the channel
+ *  @param items array of room for n items to copy them to
+ *  @param n maximum number of items
+ *  @return number of items received, ERR_CLOSED if the channel is closed
+ *          and drained, ERR_INVAL for invalid input
+ */
+int chan_recv_batch(chan_t *c, void *items, int n) {
+    int k;
+
+    if (c == NULL || c->slots == NULL || items == NULL || n <= 0) {
+        return ERR_INVAL;
+    }
+    k = ring_get(c, items, n);
+    if (k == 0) {
+        /* Empty, park until a sender fills a slot */
+        mutex_lock(&c->lock);
+        atomic_add(&c->recv_waiters, 1);
+        while ((k = ring_get(c, items, n)) == 0 && !c->closed) {
+            cond_wait(&c->not_empty, &c->lock);
+        }
+        atomic_add(&c->recv_waiters, -1);
+        mutex_unlock(&c->lock);
+        if (k == 0) {
+            return ERR_CLOSED;
+        }
+    }
+    chan_notify(c, &c->send_waiters, &c->not_full, k);
+    return k;
+}
+
+/** @brief close a channel
+ *
+ *  Further sends fail, receives drain the items left in the channel and
+ *  then fail. Threads parked on the channel are woken up. Items sent
+ *  concurrently with chan_close may or may not be delivered, so producers
+ *  should be done before the channel is closed.
+ *
+ *  @param c the channel
+ *  @return void
+ */
+void chan_close(chan_t *c) {
+    if (c == NULL || c->slots == NULL) {
+        return;
+    }
+    mutex_lock(&c->lock);
+    c->closed = 1;
+    cond_broadcast(&c->not_full);
+    cond_broadcast(&c->not_empty);
+    mutex_unlock(&c->lock);
+}
+
+/** @brief destroy a channel
+ *
+ *  @pre no thread is using the channel
+ *  @param c the channel
+ *  @return void
+ */
+void chan_destroy(chan_t *c) {
+    if (c == NULL || c->slots == NULL) {
+        return;
+    }
+    cond_destroy(&c->not_empty);
+    cond_destroy(&c->not_full);
+    mutex_destroy(&c->lock);
+    free(c->slots);
+    c->slots = NULL;
+}
+
+/** @brief copy up to n items into free slots of the ring
+ *
+ *  @param c the channel
+ *  @param items the items
+ *  @param n maximum number of items
+ *  @return number of items copied, 0 if the ring is full
+ */
+static int ring_put(chan_t *c, const char *items, int n) {
+    unsigned int pos;
+    int i, k;
+
+    k = ring_claim(c, &c->tail, n, SEND_READY, &pos);
+    for (i = 0; i < k; i++) {
+        memcpy(SLOT_DATA(c, pos + i), items + i * c->elem_size,
+               c->elem_size);
+        compiler_barrier();
+        SLOT_SEQ(c, pos + i) = pos + i + RECV_READY;
+    }
+    return k;
+}
+
+/** @brief copy up to n items out of full slots of the ring
+ *
+ *  @param c the channel
+ *  @param items where to copy the items to
+ *  @param n maximum number of items
+ *  @return number of items copied, 0 if the ring is empty
+ */
+static int ring_get(chan_t *c, char *items, int n) {
+    unsigned int pos;
+    int i, k;
+
+    k = ring_claim(c, &c->head, n, RECV_READY, &pos);
+    for (i = 0; i < k; i++) {
+        memcpy(items + i * c->elem_size, SLOT_DATA(c, pos + i),
+               c->elem_size);
+        compiler_barrier();
+        /* Ready for the sender of the next lap */
+        SLOT_SEQ(c, pos + i) = pos + i + c->mask + 1;
+    }
+    return k;
+}
+
+/** @brief claim a run of up to n ready slots
+ *
+ *  A slot is ready at position pos when its sequence number is pos plus
+ *  ready. Slots behind the one at *posp that are ready can only be claimed
+ *  through *posp, so checking them before the compare and swap is safe.
+ *
+ *  @param c the channel
+ *  @param posp the position to advance, tail for senders, head for receivers
+ *  @param n maximum number of slots
+ *  @param ready SEND_READY or RECV_READY
+ *  @param startp set to the first claimed position
+ *  @return number of slots claimed, 0 if there are no ready slots
+ */
+static int ring_claim(chan_t *c, unsigned int *posp, int n, int ready,
+                      unsigned int *startp) {
+    unsigned int pos = *(volatile unsigned int *)posp;
+    int avail, diff;
+
+    while (1) {
+        diff = 0;
+        for (avail = 0; avail < n && avail <= c->mask; avail++) {
+            diff = (int)(SLOT_SEQ(c, pos + avail) - (pos + avail + ready));
+            if (diff != 0) {
+                break;
+            }
+        }
+        compiler_barrier();
+        if (avail == 0 && diff < 0) {
+            return 0;   /* The slot still belongs to the previous lap */
+        }
+        if (avail > 0 && compare_and_swap((int *)posp, (int)pos,
+                                          (int)(pos + avail)) == (int)pos) {
+            *startp = pos;
+            return avail;
+        }
+        pos = *(volatile unsigned int *)posp;
+    }
+}
+
+/** @brief wake up threads parked on the other side of the channel
+ *
+ *  The waiters count is read with a locked instruction so that it is not
+ *  read before the slots we just published are visible.
+ *
+ *  @param c the channel
+ *  @param waiters waiters count of the other side
+ *  @param cv cond var the other side parks on
+ *  @param n number of slots we just made available
+ *  @return void
+ */
+static void chan_notify(chan_t *c, int *waiters, cond_t *cv, int n) {
+    if (n == 0 || atomic_add(waiters, 0) == 0) {
+        return;
+    }
+    mutex_lock(&c->lock);
+    if (n == 1) {
+        cond_signal(cv);
+    }
+    else {
+        cond_broadcast(cv);
+    }
+    mutex_unlock(&c->lock);
+}
@@ -1,34 +1,25 @@
 /** @file cond_var.c
  *  @brief Implementation of condition variable calls
  *
+ *  A waiter reads the sequence number of the cond var while it still holds
+ *  the mutex and parks on it as long as it is unchanged. Signals and
+ *  broadcasts bump the sequence number before unparking, so a signal sent
+ *  between the waiter unlocking the mutex and parking makes the park
+ *  return at once instead of being lost.
+ *
  *  @author Rohit Upadhyaya (rjupadhy)
  *  @author Prajwal Yadapadithaya (pyadapad)
  */
 #include <cond.h>
 #include <asm.h>
-#include <list.h>
-#include <syscall.h>
+#include <park.h>
 #include <errors.h>
-#include <malloc.h>
+#include <stddef.h>
 #include <mutex.h>
-#include <thread.h>
-#include <panic.h>
-#include <simics.h>
-
-#define DESCHEDULE 0
-#define RUNNABLE 1
-
-/** @brief a struct to keep track of queue of threads blocked */
-typedef struct blocked_thread {
-    int tid;
-	int reject;
-    list_head link;
-} blocked_thread_t;
 
 /** @brief initialize a cond var
  *
- *  Set status of cond var to 1. It "initializes" the mutex pointed to 
- *  by cv. This also initializes the head of queue of waiting threads.
+ *  Set status of cond var to 1 and its sequence number to 0.
  *  Calling this function on an already initialized function can lead to
  *  undefined behavior.
  *
@@ -39,11 +30,8 @@ int cond_init(cond_t *cv) {
     if (cv == NULL) {
         return ERR_INVAL;
     }
+    cv->seq = 0;
     cv->status = COND_VAR_VALID;
-    if (mutex_init(&cv->queue_mutex) < 0) {
-        return ERR_INVAL;
-    }
-    init_head(&cv->waiting);
     return 0;
 }
 
@@ -61,17 +49,17 @@ void cond_destroy(cond_t *cv) {
     if (cv == NULL) {
         return;
     }
-    mutex_destroy(&cv->queue_mutex);
     cv->status = COND_VAR_INVALID;
 }
 
 /** @brief This function allows a thread to sleep on a signal issued on 
  *         some condition
  *
- *  This function adds thread to the queue of blocked threads and deschedules
- *  itself after unlocking the mutex associated with the cond var. When the 
- *  thread is woken up the thread is removed from the queue and the mutex is 
- *  locked before returning.
+ *  This function parks the thread on the sequence number of the cond var
+ *  after unlocking the mutex associated with the cond var. The mutex is
+ *  locked again before returning. Parking a green thread only parks the
+ *  green thread, so the kernel thread it runs on can run other green
+ *  threads meanwhile.
  *
  *  @pre the mutex pointed to by mp must be locked
  *  @post the mutex pointed to by mp is locked
@@ -85,30 +73,11 @@ void cond_wait(cond_t *cv, mutex_t *mp) {
 		return;
 	}
 
-    int tid = thr_getid();
-    blocked_thread_t *t = (blocked_thread_t *)
-                            malloc(sizeof(blocked_thread_t));
-    if (t == NULL) {
-        die("Program ran out of memory!");
-    }
-
-    t->tid = tid;
-	t->reject = DESCHEDULE;
-
-    /* Protect accesses to the queue */
-    mutex_lock(&cv->queue_mutex);
-    add_to_tail(&t->link, &cv->waiting);
-    mutex_unlock(&cv->queue_mutex);
+    int seq = cv->seq;  /* Read under mp, signals bump it under mp */
 
     mutex_unlock(mp);   /* Unlock before we go to sleep */
-	deschedule(&t->reject);
+    thr_park(&cv->seq, seq);
     mutex_lock(mp);     /* Mutex is locked upon return */
-
-    /* Protect accesses to the queue */
-	mutex_lock(&cv->queue_mutex);
-	del_entry(&t->link);
-	free(t);
-	mutex_unlock(&cv->queue_mutex);
 }
 
 
@@ -132,17 +101,8 @@ void cond_signal(cond_t *cv) {
 	if(cv->status == COND_VAR_INVALID) {
 		return;
 	}
-	mutex_lock(&cv->queue_mutex); 
-    list_head *waiting_thread = get_first(&cv->waiting);
-    if (waiting_thread != NULL) {
-        blocked_thread_t *thr = get_entry(waiting_thread, blocked_thread_t, 
-                                          link);
-        int next_tid = thr->tid;
-		thr->reject = RUNNABLE;
-        make_runnable(next_tid);
-    }
-    mutex_unlock(&cv->queue_mutex);
-
+    atomic_add(&cv->seq, 1);
+    thr_unpark_one(&cv->seq);
 }
 
 /** @brief this function signals all threads waiting on this cond var
@@ -159,16 +119,6 @@ void cond_broadcast(cond_t *cv) {
 	if(cv->status == COND_VAR_INVALID) {
 		return;
 	}
-	mutex_lock(&cv->queue_mutex);
-    
-    list_head *waiting_thread = get_first(&cv->waiting);
-	while(waiting_thread != NULL && waiting_thread != &cv->waiting) {
-        blocked_thread_t *thr = get_entry(waiting_thread, blocked_thread_t, 
-                                          link);
-        int next_tid = thr->tid;
-		thr->reject = RUNNABLE;
-        make_runnable(next_tid);
-		waiting_thread = waiting_thread->next;
-	}
-    mutex_unlock(&cv->queue_mutex);
+    atomic_add(&cv->seq, 1);
+    thr_unpark_all(&cv->seq);
 }
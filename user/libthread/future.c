@@ -0,0 +1,321 @@
+/** @file future.c
+ *  @brief Implementation of futures
+ *
+ *  A future is a pool task plus the slot its result is stored in. async()
+ *  queues the future on the worker pool; whoever runs it stores the value,
+ *  broadcasts on the future's cond var and hands the value on to any
+ *  continuations registered with future_then().
+ *
+ *  A thread asking for the value of a future no worker has picked up yet
+ *  takes it back from the pool and runs it itself. This saves a context
+ *  switch and means workers blocked in future_get() can not starve the
+ *  pool of threads to run what they are waiting on.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <future.h>
+#include <mutex.h>
+#include <cond.h>
+#include <list.h>
+#include <errors.h>
+#include <malloc.h>
+#include <pool.h>
+
+#define TRUE 1
+#define FALSE 0
+
+#define FUTURE_PENDING 0
+#define FUTURE_RUNNING 1
+#define FUTURE_READY 2
+
+/** @brief an asynchronously computed value */
+struct future {
+    pool_task_t task;
+    void *(*func)(void *);
+    void *arg;
+    void *value;
+    int state;
+    mutex_t lock;
+    cond_t done;            /* Broadcast when the value is ready */
+    list_head thens;        /* Continuations to run on the value */
+    list_head then_link;    /* Link in the thens list of our parent */
+    list_head waiters;      /* future_wait_any callers waiting on us */
+};
+
+/** @brief a thread blocked in future_wait_any */
+typedef struct any_waiter {
+    mutex_t lock;
+    cond_t wakeup;
+    int fired;
+} any_waiter_t;
+
+/** @brief links an any_waiter_t into the waiters list of one future */
+typedef struct any_link {
+    list_head link;
+    any_waiter_t *waiter;
+} any_link_t;
+
+static future_t *future_alloc(void *(*fn)(void *), void *arg);
+static void future_run(pool_task_t *task);
+static void future_complete(future_t *f, void *value);
+
+/** @brief run fn(arg) asynchronously
+ *
+ *  @param fn the function to run
+ *  @param arg the argument to the function
+ *  @return a future holding the return value of fn, NULL on failure
+ */
+future_t *async(void *(*fn)(void *), void *arg) {
+    future_t *f;
+
+    if (fn == NULL) {
+        return NULL;
+    }
+    if ((f = future_alloc(fn, arg)) == NULL) {
+        return NULL;
+    }
+    if (pool_submit(&f->task) < 0) {
+        future_destroy(f);
+        return NULL;
+    }
+    return f;
+}
+
+/** @brief wait for a future to become ready and return its value
+ *
+ *  If the future has not been started yet it is run by the calling thread.
+ *
+ *  @param f the future
+ *  @return the value returned by the function of the future
+ */
+void *future_get(future_t *f) {
+    void *value;
+
+    if (pool_cancel(&f->task) == 0) {
+        future_run(&f->task);
+    }
+    mutex_lock(&f->lock);
+    while (f->state != FUTURE_READY) {
+        cond_wait(&f->done, &f->lock);
+    }
+    value = f->value;
+    mutex_unlock(&f->lock);
+    return value;
+}
+
+/** @brief get the value of a future without blocking
+ *
+ *  @param f the future
+ *  @param valuep where the value is stored if the future is ready
+ *  @return 0 if the future is ready, ERR_BUSY if it is not
+ */
+int future_try_get(future_t *f, void **valuep) {
+    int ret = ERR_BUSY;
+
+    mutex_lock(&f->lock);
+    if (f->state == FUTURE_READY) {
+        if (valuep != NULL) {
+            *valuep = f->value;
+        }
+        ret = 0;
+    }
+    mutex_unlock(&f->lock);
+    return ret;
+}
+
+/** @brief chain a function to run on the value of a future
+ *
+ *  Once f is ready, fn is queued on the pool with the value of f as its
+ *  argument. f must not be destroyed before it is ready.
+ *
+ *  @param f the future whose value is passed on
+ *  @param fn the function to run on the value of f
+ *  @return a future holding the return value of fn, NULL on failure
+ */
+future_t *future_then(future_t *f, void *(*fn)(void *)) {
+    future_t *g;
+
+    if (f == NULL || fn == NULL) {
+        return NULL;
+    }
+    if ((g = future_alloc(fn, NULL)) == NULL) {
+        return NULL;
+    }
+    mutex_lock(&f->lock);
+    if (f->state != FUTURE_READY) {
+        add_to_tail(&g->then_link, &f->thens);
+        mutex_unlock(&f->lock);
+        return g;
+    }
+    g->arg = f->value;
+    mutex_unlock(&f->lock);
+
+    if (pool_submit(&g->task) < 0) {
+        future_run(&g->task);
+    }
+    return g;
+}
+
+/** @brief wait until at least one of a set of futures is ready
+ *
+ *  The caller hangs a waiter off every future which is not ready and
+ *  sleeps on it. Whichever future completes first wakes the caller up.
+ *
+ *  @param futures array of futures
+ *  @param n number of futures in the array
+ *  @return index of a ready future, negative error code on failure
+ */
+int future_wait_any(future_t **futures, int n) {
+    any_waiter_t waiter;
+    any_link_t *links;
+    int i, linked;
+    int ready = ERR_INVAL;
+
+    if (futures == NULL || n <= 0) {
+        return ERR_INVAL;
+    }
+    links = (any_link_t *)malloc(n * sizeof(any_link_t));
+    if (links == NULL) {
+        return ERR_NOMEM;
+    }
+    mutex_init(&waiter.lock);
+    cond_init(&waiter.wakeup);
+    waiter.fired = FALSE;
+
+    for (linked = 0; linked < n; linked++) {
+        future_t *f = futures[linked];
+        mutex_lock(&f->lock);
+        if (f->state == FUTURE_READY) {
+            mutex_unlock(&f->lock);
+            ready = linked;
+            break;
+        }
+        links[linked].waiter = &waiter;
+        add_to_tail(&links[linked].link, &f->waiters);
+        mutex_unlock(&f->lock);
+    }
+
+    if (ready < 0) {
+        mutex_lock(&waiter.lock);
+        while (!waiter.fired) {
+            cond_wait(&waiter.wakeup, &waiter.lock);
+        }
+        mutex_unlock(&waiter.lock);
+    }
+
+    for (i = 0; i < linked; i++) {
+        future_t *f = futures[i];
+        mutex_lock(&f->lock);
+        del_entry(&links[i].link);
+        if (ready < 0 && f->state == FUTURE_READY) {
+            ready = i;
+        }
+        mutex_unlock(&f->lock);
+    }
+    free(links);
+    cond_destroy(&waiter.wakeup);
+    mutex_destroy(&waiter.lock);
+    return ready;
+}
+
+/** @brief release a future
+ *
+ *  @pre the future is ready and nobody else is using it
+ *  @param f the future
+ *  @return void
+ */
+void future_destroy(future_t *f) {
+    if (f == NULL) {
+        return;
+    }
+    cond_destroy(&f->done);
+    mutex_destroy(&f->lock);
+    free(f);
+}
+
+/** @brief allocate and initialize a pending future
+ *
+ *  @param fn the function of the future
+ *  @param arg the argument to the function
+ *  @return the new future, NULL if we are out of memory
+ */
+static future_t *future_alloc(void *(*fn)(void *), void *arg) {
+    future_t *f = (future_t *)malloc(sizeof(future_t));
+    if (f == NULL) {
+        return NULL;
+    }
+    f->task.run = future_run;
+    f->task.queued = FALSE;
+    f->func = fn;
+    f->arg = arg;
+    f->value = NULL;
+    f->state = FUTURE_PENDING;
+    if (mutex_init(&f->lock) < 0 || cond_init(&f->done) < 0) {
+        free(f);
+        return NULL;
+    }
+    init_head(&f->thens);
+    init_head(&f->waiters);
+    return f;
+}
+
+/** @brief pool entry point of a future
+ *
+ *  @param task the task embedded in the future
+ *  @return void
+ */
+static void future_run(pool_task_t *task) {
+    future_t *f = get_entry(task, future_t, task);
+
+    mutex_lock(&f->lock);
+    f->state = FUTURE_RUNNING;
+    mutex_unlock(&f->lock);
+
+    future_complete(f, f->func(f->arg));
+}
+
+/** @brief store the value of a future and wake up everyone waiting on it
+ *
+ *  Continuations are moved to a local list while the lock is held, since
+ *  the owner of f may destroy it as soon as it sees the value.
+ *
+ *  @param f the future
+ *  @param value the value of the future
+ *  @return void
+ */
+static void future_complete(future_t *f, void *value) {
+    list_head thens;
+    list_head *p;
+
+    init_head(&thens);
+    mutex_lock(&f->lock);
+    f->value = value;
+    f->state = FUTURE_READY;
+    cond_broadcast(&f->done);
+
+    p = get_first(&f->waiters);
+    while (p != NULL && p != &f->waiters) {
+        any_waiter_t *w = get_entry(p, any_link_t, link)->waiter;
+        mutex_lock(&w->lock);
+        w->fired = TRUE;
+        cond_signal(&w->wakeup);
+        mutex_unlock(&w->lock);
+        p = p->next;
+    }
+
+    while ((p = get_first(&f->thens)) != NULL) {
+        del_entry(p);
+        add_to_tail(p, &thens);
+    }
+    mutex_unlock(&f->lock);
+
+    while ((p = get_first(&thens)) != NULL) {
+        future_t *g = get_entry(p, future_t, then_link);
+        del_entry(p);
+        g->arg = value;
+        if (pool_submit(&g->task) < 0) {
+            future_run(&g->task);
+        }
+    }
+}
@@ -0,0 +1,501 @@
+/** @file green.c
+ *  @brief Implementation of green threads
+ *
+ *  Every kernel thread created by green_init runs a scheduler loop (a
+ *  "vproc") with its own queue of runnable green threads. A green thread
+ *  is placed on a vproc when it is created and stays there. Switching
+ *  between a green thread and its scheduler is done by green_switch in
+ *  asm.S, which only saves the callee save registers and the stack
+ *  pointer, so it never enters the kernel.
+ *
+ *  A green thread always switches back to its scheduler with the vproc
+ *  lock held and the scheduler releases it. This closes the window between
+ *  a green thread putting itself to sleep and being woken up by another
+ *  kernel thread. A vproc with nothing to run deschedules its kernel
+ *  thread until a green thread is made runnable on it.
+ *
+ *  cond_wait and mutex_lock ask green_self whether they are running on a
+ *  green thread and if so park it with green_sleep / green_yield instead
+ *  of descheduling or spinning the kernel thread.
+ *
+ *  Green stacks are a power of two in size and aligned to their size,
+ *  with a small header at the bottom pointing back to their thread. So
+ *  green_self finds the calling green thread from the address of a local
+ *  variable, without asking the kernel who is running.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <green.h>
+#include <thread.h>
+#include <mutex.h>
+#include <cond.h>
+#include <list.h>
+#include <asm.h>
+#include <syscall.h>
+#include <errors.h>
+#include <malloc.h>
+#include <malloc_ext.h>
+#include <thr_internals.h>
+
+#define TRUE 1
+#define FALSE 0
+
+#define GREEN_READY 0
+#define GREEN_RUNNING 1
+#define GREEN_BLOCKED 2
+#define GREEN_EXITED 3
+
+#define GREEN_STACK_MAGIC 0x67726e21
+
+/** @brief a kernel thread running green threads */
+typedef struct vproc {
+    int tid;
+    int lock;               /* Protects ready, idle and the green states */
+    int idle;
+    int reject;             /* deschedule flag while idle */
+    list_head ready;
+    green_t *current;       /* Only touched by the vproc itself */
+    void *sched_esp;        /* Saved context of the scheduler loop */
+    struct tcb *tcb;        /* TCB of the kernel thread */
+} vproc_t;
+
+/** @brief a green thread */
+struct green_thread {
+    void *esp;              /* Saved stack pointer while switched out */
+    char *stack;
+    void *(*func)(void *);
+    void *arg;
+    void *status;
+    int state;
+    vproc_t *vproc;
+    list_head link;         /* Link in the ready queue of vproc */
+    int exited;
+    mutex_t join_lock;
+    cond_t joined;
+};
+
+/** @brief the bottom of the stack of a green thread */
+typedef struct green_stack {
+    unsigned int magic;
+    green_t *green;
+} green_stack_t;
+
+/** @brief global state of the green thread library */
+static struct {
+    int active;
+    int nvprocs;
+    vproc_t *vprocs;
+    unsigned int stack_size;    /* A power of two, stacks are aligned to it */
+    char *stack_lo;             /* Bounds of all green stacks so far */
+    char *stack_hi;
+    int next_vproc;         /* Round robin placement of new threads */
+    mutex_t lock;
+    cond_t all_exited;
+    int live;               /* Green threads which have not been reaped */
+    int shutdown;
+} green;
+
+static void *vproc_main(void *arg);
+static void green_start(green_t *g);
+static void green_reap(green_t *g);
+static void vproc_wake(vproc_t *vp);
+
+/** @brief take a vproc lock
+ *
+ *  This can not be a mutex since mutex_lock itself calls into the green
+ *  scheduler. The lock is only held for a few instructions.
+ *
+ *  @param vp the vproc
+ *  @return void
+ */
+static void vp_lock(vproc_t *vp) {
+    while (!test_and_unset(&vp->lock)) {
+        yield(-1);
+    }
+}
+
+/** @brief release a vproc lock
+ *
+ *  @param vp the vproc
+ *  @return void
+ */
+static void vp_unlock(vproc_t *vp) {
+    test_and_set(&vp->lock);
+}
+
+/** @brief start the kernel threads green threads run on
+ *
+ *  thr_init must have been called before this. Can only be called once.
+ *
+ *  @param nkthreads number of kernel threads to multiplex onto
+ *  @param stack_size size of the stack of every green thread, at most
+ *         GREEN_STACK_MAX
+ *  @return 0 on success, negative error code on failure
+ */
+int green_init(int nkthreads, unsigned int stack_size) {
+    int i;
+
+    if (nkthreads <= 0 || stack_size == 0 || stack_size > GREEN_STACK_MAX ||
+        green.active) {
+        return ERR_INVAL;
+    }
+    green.vprocs = (vproc_t *)malloc(nkthreads * sizeof(vproc_t));
+    if (green.vprocs == NULL) {
+        return ERR_NOMEM;
+    }
+    mutex_init(&green.lock);
+    cond_init(&green.all_exited);
+    green.stack_size = 1;
+    while (green.stack_size < stack_size + sizeof(green_stack_t)) {
+        green.stack_size <<= 1;
+    }
+    green.stack_lo = (char *)-1;
+    green.stack_hi = NULL;
+    green.next_vproc = 0;
+    green.live = 0;
+    green.shutdown = FALSE;
+    for (i = 0; i < nkthreads; i++) {
+        vproc_t *vp = &green.vprocs[i];
+        vp->tid = -1;
+        vp->lock = 1;
+        vp->idle = FALSE;
+        vp->reject = 0;
+        vp->current = NULL;
+        vp->tcb = NULL;
+        init_head(&vp->ready);
+    }
+    green.nvprocs = nkthreads;
+    green.active = TRUE;
+
+    for (i = 0; i < nkthreads; i++) {
+        vproc_t *vp = &green.vprocs[i];
+        int tid = thr_create(vproc_main, vp);
+        if (tid < 0) {
+            green.nvprocs = i;
+            green_shutdown();
+            return tid;
+        }
+        vp->tid = tid;
+    }
+    return 0;
+}
+
+/** @brief create a green thread running func(arg)
+ *
+ *  @param func the function the thread runs
+ *  @param arg the argument to func
+ *  @return handle of the thread to pass to green_join, NULL on failure
+ */
+green_t *green_create(void *(*func)(void *), void *arg) {
+    green_t *g;
+    green_stack_t *base;
+    void **sp;
+
+    if (!green.active || green.shutdown || func == NULL) {
+        return NULL;
+    }
+    if ((g = (green_t *)malloc(sizeof(green_t))) == NULL) {
+        return NULL;
+    }
+    g->stack = (char *)memalign(green.stack_size, green.stack_size);
+    if (g->stack == NULL) {
+        free(g);
+        return NULL;
+    }
+    base = (green_stack_t *)g->stack;
+    base->magic = GREEN_STACK_MAGIC;
+    base->green = g;
+    g->func = func;
+    g->arg = arg;
+    g->status = NULL;
+    g->exited = FALSE;
+    mutex_init(&g->join_lock);
+    cond_init(&g->joined);
+
+    /* Lay out the frame green_switch pops to enter green_start(g) */
+    sp = (void **)(g->stack + green.stack_size);
+    *--sp = g;                  /* Argument to green_start */
+    *--sp = NULL;               /* Return address of green_start */
+    *--sp = (void *)green_start;
+    *--sp = NULL;               /* %ebp */
+    *--sp = NULL;               /* %ebx */
+    *--sp = NULL;               /* %esi */
+    *--sp = NULL;               /* %edi */
+    g->esp = sp;
+
+    mutex_lock(&green.lock);
+    if (g->stack < green.stack_lo) {
+        green.stack_lo = g->stack;
+    }
+    if (g->stack + green.stack_size > green.stack_hi) {
+        green.stack_hi = g->stack + green.stack_size;
+    }
+    green.live++;
+    g->vproc = &green.vprocs[green.next_vproc];
+    green.next_vproc = (green.next_vproc + 1) % green.nvprocs;
+    mutex_unlock(&green.lock);
+
+    vp_lock(g->vproc);
+    g->state = GREEN_READY;
+    add_to_tail(&g->link, &g->vproc->ready);
+    vproc_wake(g->vproc);
+    vp_unlock(g->vproc);
+    return g;
+}
+
+/** @brief wait for a green thread to exit and release it
+ *
+ *  Can be called from green threads and kernel threads alike. Only one
+ *  thread may join a given green thread.
+ *
+ *  @param g the green thread
+ *  @param statusp where the exit status is stored, can be NULL
+ *  @return 0 on success, ERR_INVAL for invalid input
+ */
+int green_join(green_t *g, void **statusp) {
+    if (g == NULL) {
+        return ERR_INVAL;
+    }
+    mutex_lock(&g->join_lock);
+    while (!g->exited) {
+        cond_wait(&g->joined, &g->join_lock);
+    }
+    mutex_unlock(&g->join_lock);
+    if (statusp != NULL) {
+        *statusp = g->status;
+    }
+    cond_destroy(&g->joined);
+    mutex_destroy(&g->join_lock);
+    ((green_stack_t *)g->stack)->magic = 0;
+    free(g->stack);
+    free(g);
+    return 0;
+}
+
+/** @brief let the other green threads of this vproc run
+ *
+ *  Does nothing when not called from a green thread.
+ *
+ *  @return void
+ */
+void green_yield(void) {
+    green_t *g = green_self();
+    if (g == NULL) {
+        return;
+    }
+    vp_lock(g->vproc);
+    g->state = GREEN_READY;
+    add_to_tail(&g->link, &g->vproc->ready);
+    green_switch(&g->esp, g->vproc->sched_esp);
+}
+
+/** @brief exit the calling green thread
+ *
+ *  @param status the exit status handed to green_join
+ *  @return does not return when called from a green thread
+ */
+void green_exit(void *status) {
+    green_t *g = green_self();
+    if (g == NULL) {
+        return;
+    }
+    g->status = status;
+    vp_lock(g->vproc);
+    g->state = GREEN_EXITED;
+    green_switch(&g->esp, g->vproc->sched_esp);
+}
+
+/** @brief wait for all green threads to exit and stop the vprocs
+ *
+ *  Must be called from a kernel thread. Green threads which have exited
+ *  can still be joined afterwards.
+ *
+ *  @return void
+ */
+void green_shutdown(void) {
+    int i;
+
+    if (!green.active) {
+        return;
+    }
+    mutex_lock(&green.lock);
+    while (green.live > 0) {
+        cond_wait(&green.all_exited, &green.lock);
+    }
+    green.shutdown = TRUE;
+    mutex_unlock(&green.lock);
+
+    for (i = 0; i < green.nvprocs; i++) {
+        vproc_t *vp = &green.vprocs[i];
+        vp_lock(vp);
+        vproc_wake(vp);
+        vp_unlock(vp);
+        thr_join(vp->tid, NULL);
+    }
+    green.active = FALSE;
+    cond_destroy(&green.all_exited);
+    mutex_destroy(&green.lock);
+    free(green.vprocs);
+}
+
+/** @brief return the green thread we are running on
+ *
+ *  Kernel threads and scheduler loops run on stacks outside the heap, so
+ *  only a green thread finds itself within the bounds of the green
+ *  stacks. Its stack then starts at the address of a local rounded down
+ *  to the stack size.
+ *
+ *  @return the current green thread, NULL when running on a plain
+ *          kernel thread or in a scheduler loop
+ */
+green_t *green_self(void) {
+    char here;
+    green_stack_t *base;
+
+    if (!green.active || &here < green.stack_lo || &here >= green.stack_hi) {
+        return NULL;
+    }
+    base = (green_stack_t *)((unsigned int)&here & ~(green.stack_size - 1));
+    return (base->magic == GREEN_STACK_MAGIC) ? base->green : NULL;
+}
+
+/** @brief return the TCB of the kernel thread a green thread runs on
+ *
+ *  @param g the green thread
+ *  @return the TCB
+ */
+struct tcb *green_tcb(green_t *g) {
+    return g->vproc->tcb;
+}
+
+/** @brief park a green thread until *flag is set and it is woken
+ *
+ *  The green counterpart of deschedule(flag). Whoever wakes us up sets
+ *  *flag through green_wakeup, and the caller must not stop waiting for
+ *  the thread until *flag is set.
+ *
+ *  @param g the calling green thread
+ *  @param flag we do not sleep if this is already set
+ *  @return void
+ */
+void green_sleep(green_t *g, int *flag) {
+    vp_lock(g->vproc);
+    if (*flag) {
+        vp_unlock(g->vproc);
+        return;
+    }
+    g->state = GREEN_BLOCKED;
+    green_switch(&g->esp, g->vproc->sched_esp);
+}
+
+/** @brief set *flag and make a green thread parked on it runnable again
+ *
+ *  The green counterpart of setting the flag and calling make_runnable.
+ *  The flag is set with the vproc lock held. Once it is set g may stop
+ *  waiting and exit, but it can not switch out to be reaped before we
+ *  release the lock, so g is not touched after it could be freed. For
+ *  the same reason a thread found blocked is still blocked on this flag.
+ *
+ *  @param g the green thread, waiting for *flag to be set
+ *  @param flag the flag g waits on
+ *  @return void
+ */
+void green_wakeup(green_t *g, int *flag) {
+    vproc_t *vp = g->vproc;
+    vp_lock(vp);
+    *(volatile int *)flag = 1;
+    if (g->state == GREEN_BLOCKED) {
+        g->state = GREEN_READY;
+        add_to_tail(&g->link, &vp->ready);
+        vproc_wake(vp);
+    }
+    vp_unlock(vp);
+}
+
+/** @brief the scheduler loop of a vproc
+ *
+ *  @param arg the vproc
+ *  @return NULL once green_shutdown is called
+ */
+static void *vproc_main(void *arg) {
+    vproc_t *vp = (vproc_t *)arg;
+    list_head *p;
+    green_t *g;
+
+    vp->tid = thr_getid();
+    vp->tcb = current_tcb();
+    vp_lock(vp);
+    while (1) {
+        while ((p = get_first(&vp->ready)) == NULL) {
+            if (green.shutdown) {
+                vp_unlock(vp);
+                return NULL;
+            }
+            vp->idle = TRUE;
+            vp->reject = 0;
+            vp_unlock(vp);
+            deschedule(&vp->reject);
+            vp_lock(vp);
+            vp->idle = FALSE;
+        }
+        del_entry(p);
+        g = get_entry(p, green_t, link);
+        g->state = GREEN_RUNNING;
+        vp->current = g;
+        vp_unlock(vp);
+
+        green_switch(&vp->sched_esp, g->esp);
+
+        /* g switched back to us holding the vproc lock */
+        vp->current = NULL;
+        if (g->state == GREEN_EXITED) {
+            vp_unlock(vp);
+            green_reap(g);
+            vp_lock(vp);
+        }
+    }
+}
+
+/** @brief first function run on the stack of a green thread
+ *
+ *  @param g the green thread
+ *  @return does not return
+ */
+static void green_start(green_t *g) {
+    green_exit(g->func(g->arg));
+}
+
+/** @brief hand an exited green thread over to its joiner
+ *
+ *  Run by the scheduler once it is off the stack of g, so that the
+ *  joiner may free the stack right away.
+ *
+ *  @param g the exited green thread
+ *  @return void
+ */
+static void green_reap(green_t *g) {
+    mutex_lock(&g->join_lock);
+    g->exited = TRUE;
+    cond_broadcast(&g->joined);
+    mutex_unlock(&g->join_lock);
+
+    mutex_lock(&green.lock);
+    if (--green.live == 0) {
+        cond_broadcast(&green.all_exited);
+    }
+    mutex_unlock(&green.lock);
+}
+
+/** @brief wake up a vproc if it is idle
+ *
+ *  @pre the vproc lock is held
+ *  @param vp the vproc
+ *  @return void
+ */
+static void vproc_wake(vproc_t *vp) {
+    if (vp->idle) {
+        vp->reject = 1;
+        make_runnable(vp->tid);
+    }
+}
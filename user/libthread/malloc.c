@@ -2,64 +2,716 @@
  * @file malloc.c
  * @brief This file implements the thread safe functions
  * for malloc, calloc, realloc and free.
+ *
+ * The heap is shared by all threads and protected by a mutex. Once the
+ * thread library is initialized every thread also keeps a cache of free
+ * small blocks, one list per block size class, in a thread specific data
+ * slot. Small blocks are allocated from and freed to the cache of the
+ * calling thread without taking the mutex. A cache is refilled from the
+ * heap in batches when it runs dry, and half of a class is flushed back
+ * when it holds more than CACHE_CLASS_BYTES. An exiting thread flushes
+ * its cache, and goes straight to the heap from then on, so that memory
+ * used by destructors running after ours does not end up in a new cache
+ * nobody destroys.
+ *
+ * Green threads share the cache of the kernel thread they run on, so a
+ * cache is never left inconsistent across a call which may block.
+ *
+ * When the profiler is on, every allocation is reported to it with the
+ * address the public function was called from.
+ *
+ * When tracing is on, every allocation, resize and free is logged as a
+ * line of a 15-213 malloc driver trace. A block gets the id of the first
+ * free slot in a fixed table, so tracing never calls malloc itself and
+ * ids are reused once their block is freed. A block is logged as freed
+ * before it can be handed out again, and resizes are logged under the
+ * mutex, so the lines of the threads are in an order which replays.
+ *
+ * @author Rohit Upadhyaya (rjupadhy)
+ * @author Prajwal Yadapadithaya (pyadapad)
  */
 
 #include <stdlib.h>
 #include <types.h>
 #include <stddef.h>
+#include <string.h>
 #include <mutex.h>
+#include <errors.h>
+#include <tsd.h>
+#include <once.h>
+#include <malloc_ext.h>
+#include <mm_malloc.h>
+#include <memlib.h>
+#include <thr_internals.h>
+#include <simics.h>
+
+#if NCLASSES != MALLINFO_CLASSES
+#error "struct mallinfo does not match the free list classes"
+#endif
+
+#define CACHE_CLASS_BYTES 4096  /* Most a thread keeps cached per class */
+#define CACHE_MAX_SIZE (SMALL_MAX - OVERHEAD)   /* Largest cached request */
+#define CACHE_CLASS(asize) (((asize) - MINBLOCK) / DSIZE)
+
+#define TRACE_BLOCKS 4096       /* Most blocks a trace follows at once */
+#define TRACE_BUCKETS 1024
+#define TRACE_HASH(ptr) (((unsigned int)(ptr) >> 3) % TRACE_BUCKETS)
 
-static mutex_t mutex;
-static int initialized = 0;
+/** @brief a thread's cache of free small blocks */
+typedef struct malloc_cache {
+    void *blocks[SMALL_CLASSES];    /* Linked through their first word */
+    int count[SMALL_CLASSES];
+} malloc_cache_t;
+
+/** @brief a traced block which has not been freed, its id is its index */
+typedef struct trace_block {
+    void *ptr;
+    size_t size;
+    struct trace_block *next;   /* In the bucket, or the free slots */
+} trace_block_t;
+
+static mutex_t mutex = MUTEX_INITIALIZER;
+static int cache_key = -1;
+static once_t cache_once = ONCE_INIT;
+
+static int trace_on = 0;
+static mutex_t trace_lock = MUTEX_INITIALIZER;
+static trace_block_t trace_blocks[TRACE_BLOCKS];
+static trace_block_t *trace_buckets[TRACE_BUCKETS];
+static trace_block_t *trace_slots = NULL;
+static int trace_nids = 0;      /* Slots never used start here */
+static int trace_nops = 0;
+static size_t trace_live = 0;
+static size_t trace_peak = 0;
+
+static malloc_cache_t *cache_get(void);
+static void cache_refill(malloc_cache_t *cache, int asize);
+static void cache_flush(malloc_cache_t *cache, int c, int n);
+static void cache_destroy(void *cache);
+static void cache_key_create(void);
+static void *do_malloc(size_t __size);
+static void *do_memalign(size_t __align, size_t __size);
+static void trace_alloc(void *ptr, size_t size);
+static void trace_realloc(void *old, void *ptr, size_t size);
+static void trace_free(void *ptr);
+static trace_block_t *trace_find(void *ptr);
+static void trace_end(void);
+
+/**
+ * @brief Thread safe malloc function.
+ *
+ * @param __size Memory to be allocated
+ *
+ * @return the memory, NULL on failure
+ */
+void *malloc(size_t __size) {
+	void *allocated = do_malloc(__size);
 
-void init_mutex() {
-	mutex_init(&mutex);
-	initialized = 1;
+	if (mprof_rate != 0) {
+		mprof_alloc(allocated, __size, __builtin_return_address(0));
+	}
+	if (trace_on) {
+		trace_alloc(allocated, __size);
+	}
+	return allocated;
 }
 
 /**
- * @brief Thread safe malloc function. This function is a wrapper
- * around _malloc() function, using a mutex.
+ * @brief This function is a wrapper around _malloc() function, using a
+ * mutex. Small requests are served from the cache of the calling thread.
  *
  * @param __size Memory to be allocated
  *
  * @return Void 
  */
-void *malloc(size_t __size) {
-	if(!initialized) {
-		init_mutex();
+static void *do_malloc(size_t __size) {
+	malloc_cache_t *cache;
+	void *allocated;
+
+	if (__size > 0 && __size <= CACHE_MAX_SIZE &&
+	    (cache = cache_get()) != NULL) {
+		int c = CACHE_CLASS(ADJUST_SIZE(__size));
+		if (cache->blocks[c] == NULL) {
+			cache_refill(cache, ADJUST_SIZE(__size));
+		}
+		if ((allocated = cache->blocks[c]) != NULL) {
+			cache->blocks[c] = *(void **)allocated;
+			cache->count[c]--;
+			return allocated;
+		}
 	}
 	mutex_lock(&mutex);
-	void * allocated =  _malloc(__size);
+	allocated =  _malloc(__size);
 	mutex_unlock(&mutex);
 	return allocated;
 }
 
 void *calloc(size_t __nelt, size_t __eltsize) {
-	if(!initialized) {
-		init_mutex();
+	size_t size = __nelt * __eltsize;
+	void *allocated;
+
+	if (size > 0 && size <= CACHE_MAX_SIZE && size / __eltsize == __nelt) {
+		if ((allocated = do_malloc(size)) != NULL) {
+			memset(allocated, 0, size);
+		}
+	} else {
+		mutex_lock(&mutex);
+		allocated =  _calloc(__nelt, __eltsize);
+		mutex_unlock(&mutex);
+	}
+	if (mprof_rate != 0) {
+		mprof_alloc(allocated, size, __builtin_return_address(0));
+	}
+	if (trace_on) {
+		trace_alloc(allocated, size);
 	}
-	mutex_lock(&mutex);
-	void * allocated =  _calloc(__nelt, __eltsize);
-	mutex_unlock(&mutex);
 	return allocated;
 }
 
 void *realloc(void *__buf, size_t __new_size) {
-	if(!initialized) {
-		init_mutex();
-	}
 	mutex_lock(&mutex);
 	void * allocated =  _realloc(__buf, __new_size);
+	/* __buf is only gone if we got a block, and nobody else has been
+	 * handed it again while we hold the mutex */
+	if (allocated != NULL && __buf != NULL && mprof_nlive != 0) {
+		mprof_free(__buf);
+	}
+	if (allocated != NULL && trace_on) {
+		trace_realloc(__buf, allocated, __new_size);
+	}
 	mutex_unlock(&mutex);
+	if (mprof_rate != 0) {
+		mprof_alloc(allocated, __new_size, __builtin_return_address(0));
+	}
 	return allocated;
 }
 
 void free(void *__buf) {
-	if(!initialized) {
-		init_mutex();
+	malloc_cache_t *cache;
+
+	if (__buf == NULL) {
+		return;
+	}
+	if (mprof_nlive != 0) {
+		mprof_free(__buf);
+	}
+	if (trace_on) {
+		trace_free(__buf);
+	}
+	int size = GET_SIZE(HDRP(__buf));
+	if (size <= SMALL_MAX && (cache = cache_get()) != NULL) {
+		int c = CACHE_CLASS(size);
+		*(void **)__buf = cache->blocks[c];
+		cache->blocks[c] = __buf;
+		if (++cache->count[c] > CACHE_CLASS_BYTES / size) {
+			cache_flush(cache, c, cache->count[c] / 2);
+		}
+		return;
 	}
 	mutex_lock(&mutex);
 	_free(__buf);
 	mutex_unlock(&mutex);
 }
+
+/**
+ * @brief Thread safe aligned malloc
+ *
+ * @param __align the alignment, a power of 2
+ * @param __size Memory to be allocated
+ *
+ * @return the memory, at a multiple of __align, NULL on failure
+ */
+void *memalign(size_t __align, size_t __size) {
+	void *allocated = do_memalign(__align, __size);
+
+	if (mprof_rate != 0) {
+		mprof_alloc(allocated, __size, __builtin_return_address(0));
+	}
+	if (trace_on) {
+		trace_alloc(allocated, __size);
+	}
+	return allocated;
+}
+
+/**
+ * @brief POSIX interface to memalign
+ *
+ * @param __memptr where to store the memory, set to NULL if __size is 0
+ * @param __align the alignment, a power of 2 and a multiple of the size
+ *        of a pointer
+ * @param __size Memory to be allocated
+ *
+ * @return 0 on success, ERR_INVAL for a bad alignment, ERR_NOMEM if out
+ *         of memory
+ */
+int posix_memalign(void **__memptr, size_t __align, size_t __size) {
+	void *allocated = NULL;
+
+	if (__align == 0 || (__align & (__align - 1)) ||
+	    __align % sizeof(void *) != 0) {
+		return ERR_INVAL;
+	}
+	if (__size > 0 && (allocated = do_memalign(__align, __size)) == NULL) {
+		return ERR_NOMEM;
+	}
+	if (mprof_rate != 0) {
+		mprof_alloc(allocated, __size, __builtin_return_address(0));
+	}
+	if (trace_on) {
+		trace_alloc(allocated, __size);
+	}
+	*__memptr = allocated;
+	return 0;
+}
+
+/**
+ * @brief Set the most the heap is grown by at once
+ *
+ * @param grow_max the cap, rounded up to whole pages, 0 to keep it
+ *
+ * @return Void
+ */
+void malloc_policy(size_t grow_max) {
+	mutex_lock(&mutex);
+	mem_policy(grow_max);
+	mutex_unlock(&mutex);
+}
+
+/**
+ * @brief Give the free memory at the end of the heap back to the kernel
+ *
+ * The cache of the calling thread is flushed first, so that its blocks
+ * do not keep the end of the heap in use. The caches of other threads
+ * are left alone.
+ *
+ * @param pad how many free bytes to keep at the end of the heap
+ *
+ * @return 1 if any memory was given back, 0 if not
+ */
+int malloc_trim(size_t pad) {
+	malloc_cache_t *cache;
+	int c, trimmed;
+
+	if (cache_key >= 0 && (cache = thr_getspecific(cache_key)) != NULL) {
+		for (c = 0; c < SMALL_CLASSES; c++) {
+			if (cache->count[c] > 0) {
+				cache_flush(cache, c, cache->count[c]);
+			}
+		}
+	}
+	mutex_lock(&mutex);
+	trimmed = mm_trim(pad);
+	mutex_unlock(&mutex);
+	return trimmed;
+}
+
+/**
+ * @brief Get the statistics of the heap
+ *
+ * @return the statistics
+ */
+struct mallinfo mallinfo(void) {
+	struct mallinfo mi;
+	mm_stats_t st;
+	unsigned int rest;
+	int c;
+
+	mutex_lock(&mutex);
+	mm_stats(&st);
+	mutex_unlock(&mutex);
+
+	mi.arena = st.heap_bytes;
+	mi.ordblks = st.free_blocks;
+	mi.hblks = st.mapped_blocks;
+	mi.hblkhd = st.mapped_bytes;
+	mi.uordblks = st.heap_bytes - st.free_bytes;
+	mi.fordblks = st.free_bytes;
+	mi.largest = st.largest;
+	mi.peak = st.peak_bytes;
+	rest = st.free_bytes - st.largest;
+	if (st.free_bytes == 0) {
+		mi.fragmentation = 0;
+	} else if (rest <= 0xffffffffu / 100) {
+		mi.fragmentation = rest * 100 / st.free_bytes;
+	} else {
+		mi.fragmentation = rest / (st.free_bytes / 100);
+	}
+	for (c = 0; c < MALLINFO_CLASSES; c++) {
+		mi.classes[c] = st.class_count[c];
+	}
+	return mi;
+}
+
+/**
+ * @brief Log the statistics of the heap
+ *
+ * @return Void
+ */
+void malloc_stats(void) {
+	struct mallinfo mi = mallinfo();
+	int c;
+
+	lprintf("malloc: heap %u in use %u free %u in %u blocks, largest %u",
+	        mi.arena, mi.uordblks, mi.fordblks, mi.ordblks, mi.largest);
+	lprintf("malloc: mapped %u in %u blocks, peak %u, fragmentation %d%%",
+	        mi.hblkhd, mi.hblks, mi.peak, mi.fragmentation);
+	for (c = 0; c < MALLINFO_CLASSES; c++) {
+		if (mi.classes[c] != 0) {
+			lprintf("malloc: class %d free blocks %u", c, mi.classes[c]);
+		}
+	}
+}
+
+/**
+ * @brief Start logging a trace of the allocations of all threads
+ *
+ * Blocks allocated before the trace started are left out of it.
+ *
+ * @return Void
+ */
+void malloc_trace_start(void) {
+	mutex_lock(&trace_lock);
+	memset(trace_buckets, 0, sizeof(trace_buckets));
+	trace_slots = NULL;
+	trace_nids = 0;
+	trace_nops = 0;
+	trace_live = 0;
+	trace_peak = 0;
+	trace_on = 1;
+	mutex_unlock(&trace_lock);
+}
+
+/**
+ * @brief Stop logging the trace and log the header it needs
+ *
+ * @return Void
+ */
+void malloc_trace_stop(void) {
+	mutex_lock(&trace_lock);
+	if (trace_on) {
+		trace_end();
+	}
+	mutex_unlock(&trace_lock);
+}
+
+/**
+ * @brief Map fresh zeroed pages outside the heap
+ *
+ * @param len the number of bytes, a multiple of PAGE_SIZE
+ *
+ * @return the first page, NULL on failure
+ */
+void *page_alloc(unsigned int len) {
+	mutex_lock(&mutex);
+	void *pages = mem_map(len);
+	mutex_unlock(&mutex);
+	return pages;
+}
+
+/**
+ * @brief Give back pages from page_alloc
+ *
+ * @param pages what page_alloc returned
+ *
+ * @return Void
+ */
+void page_free(void *pages) {
+	mutex_lock(&mutex);
+	mem_unmap(pages);
+	mutex_unlock(&mutex);
+}
+
+/**
+ * @brief Turn on the per thread caches. Called by thr_init.
+ *
+ * The key is only created the first time, however often we are called.
+ *
+ * @return 0 on success, ERR_NOMEM if no key was left
+ */
+int malloc_cache_init(void) {
+	thr_once(&cache_once, cache_key_create);
+	return (cache_key < 0) ? ERR_NOMEM : 0;
+}
+
+/**
+ * @brief Create the key of the caches, run once by malloc_cache_init
+ *
+ * @return Void
+ */
+static void cache_key_create(void) {
+	int key = thr_key_create(cache_destroy);
+
+	if (key >= 0) {
+		cache_key = key;
+	}
+}
+
+/**
+ * @brief Aligned malloc under the mutex
+ *
+ * @param __align the alignment, a power of 2
+ * @param __size Memory to be allocated
+ *
+ * @return the memory, NULL on failure
+ */
+static void *do_memalign(size_t __align, size_t __size) {
+	mutex_lock(&mutex);
+	void *allocated = _memalign(__align, __size);
+	mutex_unlock(&mutex);
+	return allocated;
+}
+
+/**
+ * @brief Find the cache of the calling thread, creating it if need be
+ *
+ * @return the cache, NULL if there is none and none can be created, or
+ *         if the thread is exiting
+ */
+static malloc_cache_t *cache_get(void) {
+	malloc_cache_t *cache;
+
+	if (cache_key < 0) {
+		return NULL;
+	}
+	if ((cache = thr_getspecific(cache_key)) != NULL) {
+		return cache;
+	}
+	if (tsd_exiting()) {
+		return NULL;
+	}
+	mutex_lock(&mutex);
+	cache = _calloc(1, sizeof(malloc_cache_t));
+	mutex_unlock(&mutex);
+	if (cache != NULL && thr_setspecific(cache_key, cache) < 0) {
+		mutex_lock(&mutex);
+		_free(cache);
+		mutex_unlock(&mutex);
+		cache = NULL;
+	}
+	return cache;
+}
+
+/**
+ * @brief Move half of what a class may hold from the heap to a cache
+ *
+ * The blocks are gathered before they are added to the cache, which may
+ * have changed while we waited for the mutex.
+ *
+ * @param cache the cache
+ * @param asize the block size of the class
+ *
+ * @return Void
+ */
+static void cache_refill(malloc_cache_t *cache, int asize) {
+	int c = CACHE_CLASS(asize), n = CACHE_CLASS_BYTES / asize / 2;
+	void *head = NULL, *tail = NULL, *block;
+	int got = 0;
+
+	mutex_lock(&mutex);
+	while (got < n && (block = _malloc(asize - OVERHEAD)) != NULL) {
+		if (GET_SIZE(HDRP(block)) != asize) {
+			_free(block);   /* An unsplit remainder, not of this class */
+			break;
+		}
+		*(void **)block = head;
+		head = block;
+		if (tail == NULL) {
+			tail = block;
+		}
+		got++;
+	}
+	mutex_unlock(&mutex);
+	if (head != NULL) {
+		*(void **)tail = cache->blocks[c];
+		cache->blocks[c] = head;
+		cache->count[c] += got;
+	}
+}
+
+/**
+ * @brief Give n blocks of a class of a cache back to the heap
+ *
+ * The blocks are taken out of the cache before we wait for the mutex.
+ *
+ * @param cache the cache
+ * @param c the class
+ * @param n the number of blocks, at most the number cached
+ *
+ * @return Void
+ */
+static void cache_flush(malloc_cache_t *cache, int c, int n) {
+	void *head = cache->blocks[c], *block;
+	int i;
+
+	block = head;
+	for (i = 1; i < n; i++) {
+		block = *(void **)block;
+	}
+	cache->blocks[c] = *(void **)block;
+	cache->count[c] -= n;
+	*(void **)block = NULL;
+
+	mutex_lock(&mutex);
+	while (head != NULL) {
+		block = head;
+		head = *(void **)head;
+		_free(block);
+	}
+	mutex_unlock(&mutex);
+}
+
+/**
+ * @brief Give all of the cache of an exiting thread back to the heap
+ *
+ * @param cache the cache
+ *
+ * @return Void
+ */
+static void cache_destroy(void *cache) {
+	malloc_cache_t *mc = (malloc_cache_t *)cache;
+	int c;
+
+	for (c = 0; c < SMALL_CLASSES; c++) {
+		if (mc->count[c] > 0) {
+			cache_flush(mc, c, mc->count[c]);
+		}
+	}
+	mutex_lock(&mutex);
+	_free(mc);
+	mutex_unlock(&mutex);
+}
+
+/**
+ * @brief Log the allocation of a block
+ *
+ * @param ptr the block, NULL if the allocation failed
+ * @param size the bytes asked for
+ *
+ * @return Void
+ */
+static void trace_alloc(void *ptr, size_t size) {
+	trace_block_t *b;
+	int h = TRACE_HASH(ptr);
+
+	if (ptr == NULL) {
+		return;
+	}
+	mutex_lock(&trace_lock);
+	if (!trace_on) {
+		mutex_unlock(&trace_lock);
+		return;
+	}
+	if ((b = trace_slots) != NULL) {
+		trace_slots = b->next;
+	} else if (trace_nids < TRACE_BLOCKS) {
+		b = &trace_blocks[trace_nids++];
+	} else {
+		lprintf("mtrace: more than %d blocks live, trace stopped",
+		        TRACE_BLOCKS);
+		trace_end();
+		mutex_unlock(&trace_lock);
+		return;
+	}
+	b->ptr = ptr;
+	b->size = size;
+	b->next = trace_buckets[h];
+	trace_buckets[h] = b;
+	if ((trace_live += size) > trace_peak) {
+		trace_peak = trace_live;
+	}
+	trace_nops++;
+	lprintf("mtrace: a %d %u", b - trace_blocks, size);
+	mutex_unlock(&trace_lock);
+}
+
+/**
+ * @brief Log the resize of a block. Called with the mutex held.
+ *
+ * A block which is not traced, or NULL, is logged as allocated.
+ *
+ * @param old the block before the resize
+ * @param ptr the block after the resize
+ * @param size the bytes asked for
+ *
+ * @return Void
+ */
+static void trace_realloc(void *old, void *ptr, size_t size) {
+	trace_block_t *b;
+	int h = TRACE_HASH(ptr);
+
+	mutex_lock(&trace_lock);
+	if (!trace_on) {
+		mutex_unlock(&trace_lock);
+		return;
+	}
+	if (old == NULL || (b = trace_find(old)) == NULL) {
+		mutex_unlock(&trace_lock);
+		trace_alloc(ptr, size);
+		return;
+	}
+	b->ptr = ptr;
+	b->next = trace_buckets[h];
+	trace_buckets[h] = b;
+	trace_live = trace_live - b->size + size;
+	if (trace_live > trace_peak) {
+		trace_peak = trace_live;
+	}
+	b->size = size;
+	trace_nops++;
+	lprintf("mtrace: r %d %u", b - trace_blocks, size);
+	mutex_unlock(&trace_lock);
+}
+
+/**
+ * @brief Log the free of a block, before anybody else can get it
+ *
+ * @param ptr the block
+ *
+ * @return Void
+ */
+static void trace_free(void *ptr) {
+	trace_block_t *b;
+
+	mutex_lock(&trace_lock);
+	if (trace_on && (b = trace_find(ptr)) != NULL) {
+		trace_live -= b->size;
+		b->next = trace_slots;
+		trace_slots = b;
+		trace_nops++;
+		lprintf("mtrace: f %d", b - trace_blocks);
+	}
+	mutex_unlock(&trace_lock);
+}
+
+/**
+ * @brief Take a traced block out of its bucket. Called with trace_lock
+ * held.
+ *
+ * @param ptr the block
+ *
+ * @return the slot of the block, NULL if it is not traced
+ */
+static trace_block_t *trace_find(void *ptr) {
+	trace_block_t **bp = &trace_buckets[TRACE_HASH(ptr)];
+	trace_block_t *b;
+
+	for (; (b = *bp) != NULL; bp = &b->next) {
+		if (b->ptr == ptr) {
+			*bp = b->next;
+			return b;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Turn tracing off and log the header of the trace: the suggested
+ * heap size, the number of ids, the number of ops and the weight. Called
+ * with trace_lock held.
+ *
+ * @return Void
+ */
+static void trace_end(void) {
+	trace_on = 0;
+	lprintf("mtrace: end %u %d %d 1", trace_peak, trace_nids, trace_nops);
+}
@@ -0,0 +1,222 @@
+/** @file mprof.c
+ *  @brief Implementation of the malloc profiler
+ *
+ *  A countdown of bytes, shared by all threads, picks the allocations
+ *  which are sampled. Call sites live in an open addressed table keyed
+ *  on the return address, and sampled blocks in a chained hash table
+ *  whose entries come from a fixed pool, so the profiler never calls
+ *  malloc itself. Samples which find either table full are dropped and
+ *  counted.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <mprof.h>
+#include <mutex.h>
+#include <asm.h>
+#include <stddef.h>
+#include <string.h>
+#include <simics.h>
+#include <thr_internals.h>
+
+#define MPROF_BUCKETS 1024
+#define SITE_HASH(pc) (((unsigned int)(pc) >> 2) % MPROF_SITES)
+#define SAMPLE_HASH(ptr) (((unsigned int)(ptr) >> 3) % MPROF_BUCKETS)
+
+/** @brief what is known of one call site */
+typedef struct mprof_site {
+    void *pc;                   /* Return address, NULL if unused */
+    unsigned int allocs;        /* Estimated allocations */
+    unsigned int bytes;         /* Estimated bytes allocated */
+    unsigned int live;          /* Estimated allocations not yet freed */
+    unsigned int live_bytes;    /* Estimated bytes not yet freed */
+} mprof_site_t;
+
+/** @brief a sampled block which has not been freed */
+typedef struct mprof_sample {
+    void *ptr;
+    struct mprof_sample *next;  /* In the bucket, or the pool */
+    mprof_site_t *site;
+    unsigned int count;         /* Allocations it stands for */
+    unsigned int bytes;         /* Bytes it stands for */
+} mprof_sample_t;
+
+unsigned int mprof_rate = 0;
+int mprof_nlive = 0;
+
+static int sample_left = 0;
+static unsigned int dropped = 0;
+static mutex_t lock = MUTEX_INITIALIZER;
+static mprof_site_t sites[MPROF_SITES];
+static mprof_sample_t samples[MPROF_SAMPLES];
+static mprof_sample_t *buckets[MPROF_BUCKETS];
+static mprof_sample_t *pool = NULL;
+static int pool_next = 0;       /* Samples never used start here */
+
+static mprof_site_t *site_get(void *pc);
+
+/** @brief turn the profiler on
+ *
+ *  @param sample_bytes about how many bytes are allocated between two
+ *         samples, 1 to record every allocation, 0 for the default
+ *  @return void
+ */
+void malloc_profile_start(unsigned int sample_bytes) {
+    mprof_rate = (sample_bytes != 0) ? sample_bytes : MPROF_DEFAULT_RATE;
+}
+
+/** @brief turn the profiler off
+ *
+ *  Blocks sampled so far are still followed until they are freed.
+ *
+ *  @return void
+ */
+void malloc_profile_stop(void) {
+    mprof_rate = 0;
+}
+
+/** @brief forget all call sites and sampled blocks
+ *
+ *  @return void
+ */
+void malloc_profile_reset(void) {
+    mutex_lock(&lock);
+    memset(sites, 0, sizeof(sites));
+    memset(buckets, 0, sizeof(buckets));
+    pool = NULL;
+    pool_next = 0;
+    dropped = 0;
+    mprof_nlive = 0;
+    mutex_unlock(&lock);
+}
+
+/** @brief log the call sites with the most live bytes
+ *
+ *  @param n how many call sites to log
+ *  @return void
+ */
+void malloc_profile_dump(int n) {
+    char logged[MPROF_SITES];
+    mprof_site_t *best;
+    int i;
+
+    memset(logged, 0, sizeof(logged));
+    mutex_lock(&lock);
+    lprintf("mprof: 1 sample per %u bytes, %d live samples, %u dropped",
+            mprof_rate, mprof_nlive, dropped);
+    while (n-- > 0) {
+        best = NULL;
+        for (i = 0; i < MPROF_SITES; i++) {
+            if (sites[i].pc != NULL && !logged[i] && (best == NULL ||
+                sites[i].live_bytes > best->live_bytes ||
+                (sites[i].live_bytes == best->live_bytes &&
+                 sites[i].bytes > best->bytes))) {
+                best = &sites[i];
+            }
+        }
+        if (best == NULL) {
+            break;
+        }
+        logged[best - sites] = 1;
+        lprintf("mprof: %p live %u bytes in %u blocks, %u bytes in %u "
+                "allocations", best->pc, best->live_bytes, best->live,
+                best->bytes, best->allocs);
+    }
+    mutex_unlock(&lock);
+}
+
+/** @brief consider an allocation for sampling
+ *
+ *  @param ptr the block, NULL if the allocation failed
+ *  @param size the bytes asked for
+ *  @param site the address the allocation was called from
+ *  @return void
+ */
+void mprof_alloc(void *ptr, unsigned int size, void *site) {
+    unsigned int rate = mprof_rate;
+    mprof_sample_t *s;
+    mprof_site_t *st;
+
+    if (ptr == NULL || rate == 0 ||
+        atomic_add(&sample_left, -(int)size) > (int)size) {
+        return;
+    }
+    sample_left = rate;
+
+    mutex_lock(&lock);
+    if ((st = site_get(site)) == NULL) {
+        dropped++;
+        mutex_unlock(&lock);
+        return;
+    }
+    if ((s = pool) != NULL) {
+        pool = s->next;
+    } else if (pool_next < MPROF_SAMPLES) {
+        s = &samples[pool_next++];
+    } else {
+        dropped++;
+        mutex_unlock(&lock);
+        return;
+    }
+    s->ptr = ptr;
+    s->site = st;
+    s->bytes = (size < rate) ? rate : size;
+    s->count = (size < rate) ? rate / (size ? size : 1) : 1;
+    s->next = buckets[SAMPLE_HASH(ptr)];
+    buckets[SAMPLE_HASH(ptr)] = s;
+    st->allocs += s->count;
+    st->bytes += s->bytes;
+    st->live += s->count;
+    st->live_bytes += s->bytes;
+    mprof_nlive++;
+    mutex_unlock(&lock);
+}
+
+/** @brief note that a block is being freed
+ *
+ *  Must be called before the block is given back, so that it can not be
+ *  allocated and sampled again first.
+ *
+ *  @param ptr the block
+ *  @return void
+ */
+void mprof_free(void *ptr) {
+    mprof_sample_t **p, *s;
+
+    mutex_lock(&lock);
+    for (p = &buckets[SAMPLE_HASH(ptr)]; (s = *p) != NULL; p = &s->next) {
+        if (s->ptr == ptr) {
+            *p = s->next;
+            s->site->live -= s->count;
+            s->site->live_bytes -= s->bytes;
+            s->next = pool;
+            pool = s;
+            mprof_nlive--;
+            break;
+        }
+    }
+    mutex_unlock(&lock);
+}
+
+/** @brief find or add the entry of a call site
+ *
+ *  Must be called with the lock held.
+ *
+ *  @param pc the return address of the call
+ *  @return the entry, NULL if the table is full
+ */
+static mprof_site_t *site_get(void *pc) {
+    unsigned int h = SITE_HASH(pc);
+    int i;
+
+    for (i = 0; i < MPROF_SITES; i++, h = (h + 1) % MPROF_SITES) {
+        if (sites[h].pc == pc) {
+            return &sites[h];
+        }
+        if (sites[h].pc == NULL) {
+            sites[h].pc = pc;
+            return &sites[h];
+        }
+    }
+    return NULL;
+}
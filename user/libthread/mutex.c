@@ -1,24 +1,29 @@
 /** @file mutex.c
  *  @brief Implementation of mutex calls
  *
+ *  A mutex is a single word which is MUTEX_UNLOCKED, MUTEX_LOCKED or
+ *  MUTEX_CONTENDED. Taking a free mutex and releasing one nobody waits
+ *  for are a single atomic instruction each. A thread finding the mutex
+ *  taken marks it contended and parks on it, and whoever unlocks a
+ *  contended mutex unparks one thread, which marks the mutex contended
+ *  again when it takes it since it can not know whether others are
+ *  still parked.
+ *
  *  @author Rohit Upadhyaya (rjupadhy)
  *  @author Prajwal Yadapadithaya (pyadapad)
  */
 #include <mutex.h>
 #include <asm.h>
-#include <list.h>
-#include <syscall.h>
+#include <park.h>
 #include <errors.h>
-#include <malloc.h>
-#include <simics.h>
+#include <stddef.h>
+#include <panic.h>
 
 /** @brief initialize a mutex
  *
- *  Set the mutex value to 1 indicating that it is unlocked
- *  and initialize the wait queue. Initializing a mutex after
- *  initializing it sets the value to 1 and "unlocks" it. Depending
- *  on if another thread holds the lock currently, this can lead to
- *  undefined behavior. 
+ *  Set the mutex value to MUTEX_UNLOCKED. Initializing a mutex after
+ *  initializing it "unlocks" it. Depending on if another thread holds
+ *  the lock currently, this can lead to undefined behavior.
  *
  *  @return 0 on success and -1 for invalid input
  */
@@ -26,35 +31,33 @@ int mutex_init(mutex_t *mp) {
     if (mp == NULL) {
         return ERR_INVAL;
     }
-    mp->value = MUTEX_VALID;
+    mp->value = MUTEX_UNLOCKED;
     return 0;
 }
 
 /** @brief destroy a mutex
  *
- *  Sets the value of the mutex to -1 indicating that it is inactive.
- *  This function does not reclaim the space used by the mutex.
+ *  The mutex holds no resources, so there is nothing to reclaim. Since a
+ *  mutex which is held, or has threads parked on it, is not unlocked, we
+ *  can tell when it is destroyed while in use and panic. Using a
+ *  destroyed mutex is undefined behavior.
  *
  *  @return void
  */
 void mutex_destroy(mutex_t *mp) {
-    if (mp == NULL) {
-        return;
+    if (mp != NULL && *(volatile int *)&mp->value != MUTEX_UNLOCKED) {
+        die("mutex_destroy() on a mutex in use");
     }
-    mp->value = MUTEX_INVALID;
 }
 
 /** @brief attempt to acquire the lock
  *
- *  We use the x86 xchg command to atomically test and set the value of the mutex.
- *  Spin lock till we get the lock. Theoretically this does not provide bounded
- *  waiting. But we are on a uniprocessor environment assuming a scheduler that
- *  does not starve any process and is fair. Assuming this and given that the
- *  number of instructions required to test and get the lock is small, once a 
- *  lock is released, it is highly likely that the next thread (that is fairly
- *  scheduled by the kernel) will get the lock. By fair scheduling we mean that
- *  no thread will wait forever (maybe something as simple as a round robin
- *  scheduler).
+ *  The fast path is a compare and swap from MUTEX_UNLOCKED to
+ *  MUTEX_LOCKED. Otherwise we swap in MUTEX_CONTENDED, which takes the
+ *  lock if it was free in the meantime, and park until the holder
+ *  unlocks it. Parked threads are woken in the order they parked in.
+ *  A green thread parks just itself, so the holder can run even if it
+ *  is queued on the same kernel thread.
  *
  *  If the mutex is corrupted or destroyed, calling this function will result 
  *  in undefined behaviour
@@ -62,7 +65,18 @@ void mutex_destroy(mutex_t *mp) {
  *  @return void
  */
 void mutex_lock(mutex_t *mp) {
-    while (!test_and_unset(&mp->value));
+    int c = compare_and_swap(&mp->value, MUTEX_UNLOCKED, MUTEX_LOCKED);
+
+    if (c == MUTEX_UNLOCKED) {
+        return;
+    }
+    if (c != MUTEX_CONTENDED) {
+        c = atomic_exchange(&mp->value, MUTEX_CONTENDED);
+    }
+    while (c != MUTEX_UNLOCKED) {
+        thr_park(&mp->value, MUTEX_CONTENDED);
+        c = atomic_exchange(&mp->value, MUTEX_CONTENDED);
+    }
 }
 
 /** @brief release a lock
@@ -73,5 +87,7 @@ void mutex_lock(mutex_t *mp) {
  *  @return void
  */
 void mutex_unlock(mutex_t *mp) {
-    test_and_set(&mp->value);
+    if (atomic_exchange(&mp->value, MUTEX_UNLOCKED) == MUTEX_CONTENDED) {
+        thr_unpark_one(&mp->value);
+    }
 }
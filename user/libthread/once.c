@@ -0,0 +1,35 @@
+/** @file once.c
+ *  @brief Implementation of one-time initialization
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <once.h>
+#include <asm.h>
+#include <park.h>
+
+/** @brief call fn exactly once for a once_t
+ *
+ *  The first caller runs fn, everybody else calling in the meantime parks
+ *  until it is done. Once fn has run this is a single load.
+ *
+ *  @param once the once_t, set to ONCE_INIT
+ *  @param fn the function to call
+ *  @return void
+ */
+void thr_once(once_t *once, void (*fn)(void)) {
+    if (*(volatile int *)&once->state == ONCE_DONE) {
+        compiler_barrier();
+        return;
+    }
+    if (compare_and_swap(&once->state, ONCE_NEW, ONCE_RUNNING) == ONCE_NEW) {
+        fn();
+        atomic_exchange(&once->state, ONCE_DONE);
+        thr_unpark_all(&once->state);
+        return;
+    }
+    while (*(volatile int *)&once->state != ONCE_DONE) {
+        thr_park(&once->state, ONCE_RUNNING);
+    }
+    compiler_barrier();
+}
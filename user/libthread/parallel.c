@@ -0,0 +1,349 @@
+/** @file parallel.c
+ *  @brief Implementation of parallel_for and parallel_reduce
+ *
+ *  A loop is run by the calling thread and one helper task per worker
+ *  of the thread pool. Every participant repeatedly claims a chunk of the
+ *  iteration space and runs the body on it until nothing is left:
+ *
+ *  - static: participant i runs chunks i, i + n, i + 2n ... of grain
+ *    iterations, so no shared state is touched while the loop runs.
+ *  - dynamic: chunks of grain iterations are claimed from a shared
+ *    counter with an atomic add.
+ *  - guided: like dynamic, but each claim takes a share of what is left
+ *    (never less than grain) with a compare and swap, so there are few
+ *    claims early on and small chunks to even out the tail.
+ *
+ *  For reductions every participant folds its chunks into a private
+ *  partial result and combines it into the loop result once when it is
+ *  done. combine must be associative and, since the order in which chunks
+ *  are claimed is not fixed, commutative.
+ *
+ *  When the caller runs out of work it takes back helper tasks no worker
+ *  has started and runs them itself, then waits for the rest to finish.
+ *
+ *  Iterations are claimed as unsigned offsets from lo, so any range of
+ *  ints works, even one spanning more than INT_MAX iterations. The
+ *  shared counter of the dynamic schedule overshoots the end by up to a
+ *  chunk per participant. If that could wrap around, chunks are claimed
+ *  with a compare and swap instead.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <parallel.h>
+#include <mutex.h>
+#include <cond.h>
+#include <asm.h>
+#include <errors.h>
+#include <pool.h>
+#include <limits.h>
+
+#define TRUE 1
+#define FALSE 0
+
+#define NR_PARTICIPANTS (POOL_MAX_THREADS + 1)
+#define CHUNKS_PER_PARTICIPANT 4
+
+struct loop;
+
+/** @brief a helper task working on a loop */
+typedef struct loop_task {
+    pool_task_t task;
+    struct loop *loop;
+    int id;
+    int submitted;
+} loop_task_t;
+
+/** @brief the shared state of one parallel loop */
+typedef struct loop {
+    int lo;
+    int hi;
+    int grain;
+    int sched;
+    unsigned int n;     /* Number of iterations */
+    int next;           /* Offset from lo of the first unclaimed iteration
+                           (dynamic, guided), used as unsigned */
+    int add_claims;     /* The dynamic counter can not wrap around */
+    void (*body)(int lo, int hi, void *ctx);
+    void *(*reduce_body)(int lo, int hi, void *ctx);
+    void *(*combine)(void *a, void *b, void *ctx);
+    void *ctx;
+    void *identity;
+    void *result;
+    int running;        /* Participants which have not finished */
+    mutex_t lock;
+    cond_t done;
+    loop_task_t helpers[NR_PARTICIPANTS];
+} loop_t;
+
+static int loop_exec(loop_t *loop);
+static void loop_helper(pool_task_t *task);
+static void loop_participate(loop_t *loop, int id);
+static int loop_claim(loop_t *loop, unsigned int *cursor, int *lo, int *hi);
+
+/** @brief run body over [lo, hi) in parallel with dynamic scheduling
+ *
+ *  @param lo first iteration
+ *  @param hi one past the last iteration
+ *  @param grain minimum number of iterations per chunk, 0 to pick one
+ *  @param body function run on each chunk
+ *  @param ctx argument passed through to body
+ *  @return 0 on success, ERR_INVAL for invalid input
+ */
+int parallel_for(int lo, int hi, int grain,
+                 void (*body)(int lo, int hi, void *ctx), void *ctx) {
+    return parallel_for_sched(lo, hi, grain, body, ctx, PARALLEL_DYNAMIC);
+}
+
+/** @brief run body over [lo, hi) in parallel
+ *
+ *  @param lo first iteration
+ *  @param hi one past the last iteration
+ *  @param grain minimum number of iterations per chunk, 0 to pick one
+ *  @param body function run on each chunk
+ *  @param ctx argument passed through to body
+ *  @param sched one of PARALLEL_STATIC, PARALLEL_DYNAMIC, PARALLEL_GUIDED
+ *  @return 0 on success, ERR_INVAL for invalid input
+ */
+int parallel_for_sched(int lo, int hi, int grain,
+                       void (*body)(int lo, int hi, void *ctx), void *ctx,
+                       int sched) {
+    loop_t loop;
+
+    if (body == NULL) {
+        return ERR_INVAL;
+    }
+    loop.lo = lo;
+    loop.hi = hi;
+    loop.grain = grain;
+    loop.sched = sched;
+    loop.body = body;
+    loop.reduce_body = NULL;
+    loop.combine = NULL;
+    loop.ctx = ctx;
+    loop.identity = NULL;
+    return loop_exec(&loop);
+}
+
+/** @brief fold body over [lo, hi) in parallel with dynamic scheduling
+ *
+ *  @param lo first iteration
+ *  @param hi one past the last iteration
+ *  @param grain minimum number of iterations per chunk, 0 to pick one
+ *  @param body function returning the partial result of a chunk
+ *  @param combine associative, commutative function merging two results
+ *  @param identity the result of an empty range
+ *  @param ctx argument passed through to body and combine
+ *  @return the combined result, identity for empty or invalid input
+ */
+void *parallel_reduce(int lo, int hi, int grain,
+                      void *(*body)(int lo, int hi, void *ctx),
+                      void *(*combine)(void *a, void *b, void *ctx),
+                      void *identity, void *ctx) {
+    return parallel_reduce_sched(lo, hi, grain, body, combine, identity, ctx,
+                                 PARALLEL_DYNAMIC);
+}
+
+/** @brief fold body over [lo, hi) in parallel
+ *
+ *  @param lo first iteration
+ *  @param hi one past the last iteration
+ *  @param grain minimum number of iterations per chunk, 0 to pick one
+ *  @param body function returning the partial result of a chunk
+ *  @param combine associative, commutative function merging two results
+ *  @param identity the result of an empty range
+ *  @param ctx argument passed through to body and combine
+ *  @param sched one of PARALLEL_STATIC, PARALLEL_DYNAMIC, PARALLEL_GUIDED
+ *  @return the combined result, identity for empty or invalid input
+ */
+void *parallel_reduce_sched(int lo, int hi, int grain,
+                            void *(*body)(int lo, int hi, void *ctx),
+                            void *(*combine)(void *a, void *b, void *ctx),
+                            void *identity, void *ctx, int sched) {
+    loop_t loop;
+
+    if (body == NULL || combine == NULL) {
+        return identity;
+    }
+    loop.lo = lo;
+    loop.hi = hi;
+    loop.grain = grain;
+    loop.sched = sched;
+    loop.body = NULL;
+    loop.reduce_body = body;
+    loop.combine = combine;
+    loop.ctx = ctx;
+    loop.identity = identity;
+    if (loop_exec(&loop) < 0) {
+        return identity;
+    }
+    return loop.result;
+}
+
+/** @brief hand a loop to the pool and take part in it
+ *
+ *  @param loop the loop, with the caller supplied fields filled in
+ *  @return 0 on success, ERR_INVAL for invalid input
+ */
+static int loop_exec(loop_t *loop) {
+    int i;
+
+    if (loop->sched != PARALLEL_STATIC && loop->sched != PARALLEL_DYNAMIC &&
+        loop->sched != PARALLEL_GUIDED) {
+        return ERR_INVAL;
+    }
+    loop->result = loop->identity;
+    if (loop->lo >= loop->hi) {
+        return 0;
+    }
+    loop->n = (unsigned int)loop->hi - (unsigned int)loop->lo;
+    if (loop->grain <= 0) {
+        loop->grain = loop->n / (NR_PARTICIPANTS * CHUNKS_PER_PARTICIPANT);
+        if (loop->grain == 0) {
+            loop->grain = 1;
+        }
+    }
+    else if ((unsigned int)loop->grain > loop->n) {
+        loop->grain = loop->n;
+    }
+    loop->add_claims =
+        ((unsigned int)loop->grain <= (UINT_MAX - loop->n) / NR_PARTICIPANTS);
+    loop->next = 0;
+    loop->running = NR_PARTICIPANTS;
+    if (mutex_init(&loop->lock) < 0 || cond_init(&loop->done) < 0) {
+        return ERR_INVAL;
+    }
+
+    /* Participant 0 is the caller */
+    for (i = 1; i < NR_PARTICIPANTS; i++) {
+        loop_task_t *helper = &loop->helpers[i];
+        helper->task.run = loop_helper;
+        helper->loop = loop;
+        helper->id = i;
+        helper->submitted = (pool_submit(&helper->task) == 0);
+    }
+
+    loop_participate(loop, 0);
+
+    for (i = 1; i < NR_PARTICIPANTS; i++) {
+        loop_task_t *helper = &loop->helpers[i];
+        if (!helper->submitted || pool_cancel(&helper->task) == 0) {
+            loop_participate(loop, i);
+        }
+    }
+
+    mutex_lock(&loop->lock);
+    while (loop->running > 0) {
+        cond_wait(&loop->done, &loop->lock);
+    }
+    mutex_unlock(&loop->lock);
+
+    cond_destroy(&loop->done);
+    mutex_destroy(&loop->lock);
+    return 0;
+}
+
+/** @brief pool entry point of a helper
+ *
+ *  @param task the task embedded in the helper
+ *  @return void
+ */
+static void loop_helper(pool_task_t *task) {
+    loop_task_t *helper = get_entry(task, loop_task_t, task);
+    loop_participate(helper->loop, helper->id);
+}
+
+/** @brief run chunks of a loop until there are none left
+ *
+ *  @param loop the loop
+ *  @param id the participant number
+ *  @return void
+ */
+static void loop_participate(loop_t *loop, int id) {
+    void *partial = loop->identity;
+    unsigned int grain = loop->grain;
+    unsigned int cursor = (id <= loop->n / grain) ? id * grain : loop->n;
+    int lo, hi;
+
+    while (loop_claim(loop, &cursor, &lo, &hi)) {
+        if (loop->reduce_body != NULL) {
+            partial = loop->combine(partial,
+                                    loop->reduce_body(lo, hi, loop->ctx),
+                                    loop->ctx);
+        }
+        else {
+            loop->body(lo, hi, loop->ctx);
+        }
+    }
+
+    mutex_lock(&loop->lock);
+    if (loop->reduce_body != NULL) {
+        loop->result = loop->combine(loop->result, partial, loop->ctx);
+    }
+    if (--loop->running == 0) {
+        cond_signal(&loop->done);
+    }
+    mutex_unlock(&loop->lock);
+}
+
+/** @brief claim the next chunk of a loop
+ *
+ *  @param loop the loop
+ *  @param cursor offset of the next chunk of this participant (static)
+ *  @param lo set to the first iteration of the chunk
+ *  @param hi set to one past the last iteration of the chunk
+ *  @return TRUE if a chunk was claimed, FALSE if the loop is drained
+ */
+static int loop_claim(loop_t *loop, unsigned int *cursor, int *lo, int *hi) {
+    unsigned int grain = loop->grain;
+    unsigned int start, size;
+
+    switch (loop->sched) {
+    case PARALLEL_STATIC:
+        start = *cursor;
+        if (start >= loop->n) {
+            return FALSE;
+        }
+        if ((loop->n - start) / NR_PARTICIPANTS < grain) {
+            *cursor = loop->n;      /* Our next chunk would be past hi */
+        }
+        else {
+            *cursor += NR_PARTICIPANTS * grain;
+        }
+        size = grain;
+        break;
+    case PARALLEL_DYNAMIC:
+        if (loop->add_claims) {
+            start = atomic_add(&loop->next, grain);
+            if (start >= loop->n) {
+                return FALSE;
+            }
+            size = grain;
+            break;
+        }
+        /* Fall through, the counter could wrap around past hi */
+    default:
+        do {
+            start = *(volatile int *)&loop->next;
+            if (start >= loop->n) {
+                return FALSE;
+            }
+            size = (loop->sched == PARALLEL_GUIDED) ?
+                   (loop->n - start) / (2 * NR_PARTICIPANTS) : 0;
+            if (size < grain) {
+                size = grain;
+            }
+            if (size > loop->n - start) {
+                size = loop->n - start;
+            }
+        } while (compare_and_swap(&loop->next, start, start + size) != start);
+        break;
+    }
+
+    if (size > loop->n - start) {
+        size = loop->n - start;
+    }
+    *lo = (int)((unsigned int)loop->lo + start);
+    *hi = (int)((unsigned int)loop->lo + start + size);
+    return TRUE;
+}
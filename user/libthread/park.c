@@ -0,0 +1,193 @@
+/** @file park.c
+ *  @brief Implementation of the park table
+ *
+ *  Parked threads are kept in a fixed table of buckets hashed by the
+ *  address they wait on. Each parked thread is described by a record on
+ *  its own stack which sits in the list of its bucket, so parking never
+ *  allocates memory. A bucket is protected by a spin lock which is only
+ *  held for a few list operations.
+ *
+ *  A parking thread checks the word and queues itself with the bucket
+ *  locked. A thread changing the word does so before it locks the bucket
+ *  to unpark, so either the parking thread sees the new value or it is
+ *  already queued when the unparking thread looks.
+ *
+ *  Unparked records are taken off the bucket with the lock held but woken
+ *  after it is dropped. A parked thread only returns once its reject flag
+ *  is set, which is the last thing the unparking thread does to its record
+ *  before waking it, so a stray make_runnable can not make it return early.
+ *  A green thread has its flag set by green_wakeup under the lock of its
+ *  vproc, which keeps the thread around until it has been requeued.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <park.h>
+#include <thread.h>
+#include <asm.h>
+#include <list.h>
+#include <syscall.h>
+#include <errors.h>
+#include <autostack.h>
+
+#define PARK_HASH_BITS 6
+#define PARK_BUCKETS (1 << PARK_HASH_BITS)
+#define PARK_HASH_MULT 2654435761u     /* 2^32 / golden ratio */
+
+/** @brief a thread parked on an address */
+typedef struct parked {
+    int *addr;
+    int tid;
+    int reject;                 /* Set once the thread has been unparked */
+    struct green_thread *green;
+    list_head link;
+} parked_t;
+
+/** @brief a bucket of the park table
+ *
+ *  The table needs no initialization, a zeroed bucket is unlocked and its
+ *  list is set up the first time the bucket is locked.
+ */
+typedef struct park_bucket {
+    int lock;                   /* 0 when free */
+    list_head parked;
+} park_bucket_t;
+
+static park_bucket_t park_table[PARK_BUCKETS];
+
+static park_bucket_t *park_bucket(int *addr);
+static void bucket_lock(park_bucket_t *b);
+static void bucket_unlock(park_bucket_t *b);
+static int park_wake(int *addr, int max);
+
+/** @brief sleep as long as *addr holds expected
+ *
+ *  @param addr the address to park on
+ *  @param expected the value *addr must hold for the thread to sleep
+ *  @return 0 once unparked, ERR_BUSY if *addr did not hold expected
+ */
+int thr_park(int *addr, int expected) {
+    park_bucket_t *b;
+    parked_t self;
+
+    b = park_bucket(addr);
+    bucket_lock(b);
+    if (*(volatile int *)addr != expected) {
+        bucket_unlock(b);
+        return ERR_BUSY;
+    }
+    self.addr = addr;
+    self.tid = thr_getid();
+    self.reject = 0;
+    self.green = green_self();
+    add_to_tail(&self.link, &b->parked);
+    bucket_unlock(b);
+    if (self.green == NULL) {
+        /* A good moment, we are about to block. A green thread runs on a
+         * heap stack, which is not ours to trim. */
+        autostack_maybe_trim();
+    }
+
+    while (!*(volatile int *)&self.reject) {
+        if (self.green != NULL) {
+            green_sleep(self.green, &self.reject);
+        }
+        else {
+            deschedule(&self.reject);
+        }
+    }
+    return 0;
+}
+
+/** @brief wake up the thread parked on addr the longest
+ *
+ *  @param addr the address
+ *  @return number of threads woken up
+ */
+int thr_unpark_one(int *addr) {
+    return park_wake(addr, 1);
+}
+
+/** @brief wake up all threads parked on addr
+ *
+ *  @param addr the address
+ *  @return number of threads woken up
+ */
+int thr_unpark_all(int *addr) {
+    return park_wake(addr, -1);
+}
+
+/** @brief wake up threads parked on addr
+ *
+ *  @param addr the address
+ *  @param max maximum number of threads to wake up, -1 for all
+ *  @return number of threads woken up
+ */
+static int park_wake(int *addr, int max) {
+    park_bucket_t *b;
+    list_head woken, *p, *next;
+    int n = 0;
+
+    b = park_bucket(addr);
+    init_head(&woken);
+    bucket_lock(b);
+    for (p = b->parked.next; p != &b->parked && n != max; p = next) {
+        parked_t *w = get_entry(p, parked_t, link);
+        next = p->next;
+        if (w->addr == addr) {
+            del_entry(p);
+            add_to_tail(p, &woken);
+            n++;
+        }
+    }
+    bucket_unlock(b);
+
+    for (p = woken.next; p != &woken; p = next) {
+        parked_t *w = get_entry(p, parked_t, link);
+        struct green_thread *green = w->green;
+        int tid = w->tid;
+        next = p->next;
+        compiler_barrier();
+        if (green != NULL) {
+            green_wakeup(green, &w->reject);
+        }
+        else {
+            *(volatile int *)&w->reject = 1;    /* w may be gone from here */
+            make_runnable(tid);
+        }
+    }
+    return n;
+}
+
+/** @brief find the bucket of an address
+ *
+ *  @param addr the address
+ *  @return the bucket
+ */
+static park_bucket_t *park_bucket(int *addr) {
+    unsigned int h = ((unsigned int)addr >> 2) * PARK_HASH_MULT;
+    return &park_table[h >> (32 - PARK_HASH_BITS)];
+}
+
+/** @brief lock a bucket
+ *
+ *  @param b the bucket
+ *  @return void
+ */
+static void bucket_lock(park_bucket_t *b) {
+    while (test_and_set(&b->lock)) {
+        yield(-1);
+    }
+    if (b->parked.next == NULL) {
+        init_head(&b->parked);
+    }
+}
+
+/** @brief unlock a bucket
+ *
+ *  @param b the bucket
+ *  @return void
+ */
+static void bucket_unlock(park_bucket_t *b) {
+    test_and_unset(&b->lock);
+}
@@ -0,0 +1,178 @@
+/** @file pool.c
+ *  @brief Implementation of the worker thread pool
+ *
+ *  Workers are created lazily: a thread is only spawned when a task is
+ *  submitted while there are at least as many queued tasks as workers
+ *  idle or starting up to take them, up to POOL_MAX_THREADS. Once created
+ *  a worker stays around and sleeps on a cond var between tasks, so later
+ *  submissions do not pay for thread creation.
+ *
+ *  Since a process only goes away when all its threads have vanished, the
+ *  pool must not keep a finished program alive. thr_exit tells the pool how
+ *  many threads are still alive and once only the workers are left they
+ *  drain the queue and exit. Each exiting worker joins the one which
+ *  exited before it, so only the last one is left for the kernel to
+ *  clean up along with the task.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <mutex.h>
+#include <cond.h>
+#include <list.h>
+#include <thread.h>
+#include <errors.h>
+#include <pool.h>
+
+#define TRUE 1
+#define FALSE 0
+
+/** @brief the state of the pool, protected by lock */
+static struct {
+    mutex_t lock;
+    cond_t work;        /* Idle workers wait here for tasks */
+    list_head queue;    /* Tasks which have not been picked up yet */
+    int nworkers;
+    int idle;
+    int starting;       /* Created but not yet looking at the queue */
+    int queued;         /* Tasks in the queue */
+    int exited;         /* tid of the last worker to exit, 0 if none */
+    int shutdown;
+} pool;
+
+static void *pool_worker(void *arg);
+
+/** @brief initialize the pool
+ *
+ *  Called once from thr_init. No threads are created here.
+ *
+ *  @return 0 on success, negative error code on failure
+ */
+int pool_init(void) {
+    if (mutex_init(&pool.lock) < 0) {
+        return ERR_INVAL;
+    }
+    if (cond_init(&pool.work) < 0) {
+        return ERR_INVAL;
+    }
+    init_head(&pool.queue);
+    pool.nworkers = 0;
+    pool.idle = 0;
+    pool.starting = 0;
+    pool.queued = 0;
+    pool.exited = 0;
+    pool.shutdown = FALSE;
+    return 0;
+}
+
+/** @brief queue a task to be run by a worker
+ *
+ *  If the queued tasks already keep every idle or starting worker busy
+ *  and the pool is not yet full a new worker is created. If the pool has
+ *  no workers at all and one cannot be created, the task is not queued.
+ *
+ *  @param task the task to run
+ *  @return 0 on success, negative error code on failure
+ */
+int pool_submit(pool_task_t *task) {
+    mutex_lock(&pool.lock);
+    if (pool.queued >= pool.idle + pool.starting &&
+        pool.nworkers < POOL_MAX_THREADS) {
+        if (thr_create(pool_worker, NULL) >= 0) {
+            pool.nworkers++;
+            pool.starting++;
+        }
+        else if (pool.nworkers == 0) {
+            mutex_unlock(&pool.lock);
+            return ERR_NOMEM;
+        }
+    }
+    task->queued = TRUE;
+    pool.queued++;
+    add_to_tail(&task->link, &pool.queue);
+    cond_signal(&pool.work);
+    mutex_unlock(&pool.lock);
+    return 0;
+}
+
+/** @brief take a task back out of the queue if no worker has started it
+ *
+ *  This lets a thread which needs the result of a queued task run it
+ *  itself instead of sleeping until a worker gets to it, which also keeps
+ *  workers waiting on other tasks from deadlocking the pool.
+ *
+ *  @param task the task to remove
+ *  @return 0 if the task was removed, ERR_BUSY if it already started
+ */
+int pool_cancel(pool_task_t *task) {
+    int ret = ERR_BUSY;
+    mutex_lock(&pool.lock);
+    if (task->queued) {
+        task->queued = FALSE;
+        pool.queued--;
+        del_entry(&task->link);
+        ret = 0;
+    }
+    mutex_unlock(&pool.lock);
+    return ret;
+}
+
+/** @brief let the workers go once nobody else is left
+ *
+ *  Called by thr_exit with the number of threads still alive. If the
+ *  workers are the only ones left they finish the queued tasks and exit.
+ *
+ *  @param live_threads number of threads which have not exited
+ *  @return void
+ */
+void pool_release(int live_threads) {
+    mutex_lock(&pool.lock);
+    if (live_threads <= pool.nworkers) {
+        pool.shutdown = TRUE;
+        cond_broadcast(&pool.work);
+    }
+    mutex_unlock(&pool.lock);
+}
+
+/** @brief body of a worker thread
+ *
+ *  Pick tasks off the queue and run them, sleeping when there is nothing
+ *  to do. On the way out, reap the worker which exited before us.
+ *
+ *  @param arg unused
+ *  @return NULL once the pool is shut down
+ */
+static void *pool_worker(void *arg) {
+    list_head *p;
+    int prev;
+
+    mutex_lock(&pool.lock);
+    pool.starting--;
+    while (1) {
+        while ((p = get_first(&pool.queue)) == NULL && !pool.shutdown) {
+            pool.idle++;
+            cond_wait(&pool.work, &pool.lock);
+            pool.idle--;
+        }
+        if (p == NULL) {
+            break;
+        }
+        pool_task_t *task = get_entry(p, pool_task_t, link);
+        del_entry(p);
+        task->queued = FALSE;
+        pool.queued--;
+        mutex_unlock(&pool.lock);
+
+        task->run(task);
+
+        mutex_lock(&pool.lock);
+    }
+    pool.nworkers--;
+    prev = pool.exited;
+    pool.exited = thr_getid();
+    mutex_unlock(&pool.lock);
+    if (prev != 0) {
+        thr_join(prev, NULL);
+    }
+    return NULL;
+}
@@ -0,0 +1,35 @@
+/** @file pool.h
+ *  @brief Interface to the pool of worker threads used by the library
+ *
+ *  The pool keeps a small set of threads (created with thr_create) alive
+ *  and hands them queued tasks. A task is embedded in whatever structure
+ *  the caller wants to run (just like a list_head), and the run function
+ *  uses get_entry() to get back to that structure.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef __POOL_H
+#define __POOL_H
+#include <list.h>
+
+/** @brief maximum number of worker threads kept in the pool */
+#define POOL_MAX_THREADS 4
+
+/** @brief a unit of work handed to the pool */
+typedef struct pool_task {
+    void (*run)(struct pool_task *task);
+    int queued;         /* Set while the task sits in the pool queue */
+    list_head link;
+} pool_task_t;
+
+int pool_init(void);
+
+int pool_submit(pool_task_t *task);
+
+int pool_cancel(pool_task_t *task);
+
+void pool_release(int live_threads);
+
+#endif  /* __POOL_H */
@@ -1,124 +1,134 @@
 /** @file rwlock.c
  *  @brief Implementation of read write lock functions
  *
+ *  The whole lock is one word holding the number of readers, a bit for a
+ *  writer holding the lock and the number of writers waiting for it.
+ *  Locking is a compare and swap on that word and threads which can not
+ *  get the lock park on it. Only a release can let a parked thread in, so
+ *  releases unpark everybody and the threads which still can not get the
+ *  lock park again.
+ *
  *  @author Rohit Upadhyaya (rjupadhy)
  *  @author Prajwal Yadapadithaya (pyadapad)
  */
-#include <cond.h>
-#include <mutex.h>
 #include <rwlock.h>
-#define RWLOCK_FREE 2
-#define RWLOCK_INVALID -1
+#include <asm.h>
+#include <park.h>
+#include <errors.h>
+#include <stddef.h>
+#include <panic.h>
 
 /** @brief function to initialize a read-write lock
  *
- *  this function initializes the cond vars associated with 
- *  the readers and writers and the mutex.
+ *  this function sets the lock free with no readers, writers or waiters.
  *
  *  @param rwlock the rwlock to initialize
  *  @return int 0 on success -1 on failure
  */
 int rwlock_init(rwlock_t *rwlock) {
-    mutex_init(&rwlock->mutex);
-    cond_init(&rwlock->readers);
-    cond_init(&rwlock->writers);
-    rwlock->type = RWLOCK_FREE;
-    rwlock->num_writers = 0;
-    rwlock->curr_readers = 0;
+    if (rwlock == NULL) {
+        return ERR_INVAL;
+    }
+    rwlock->state = 0;
     return 0;
 }
 
 /** @brief lock the read write lock
  *
- *  If the lock requested is a write lock we increment the number of writers
- *  and check if we can get the lock. We can get the lock either if the lock 
- *  is currently free or if there are no readers currently reading the state 
- *  being locked. Increasing the number of writers enures that future readers
- *  and writers wait till the writers are done. Any read lock has to wait when
- *  the lock is in write mode or the number of writers is greater than 0.
+ *  If the lock requested is a write lock we increment the number of waiting
+ *  writers and wait till there are neither readers nor a writer holding the
+ *  lock. Counting ourselves as waiting ensures that future readers wait till
+ *  the writers are done. Any read lock has to wait when the lock is held by
+ *  a writer or when writers are waiting for it.
  *
  *  @param rwlock the rwlock to lock
  *  @param type the type of lock being requested
  *  @return void
  */
 void rwlock_lock(rwlock_t *rwlock, int type) {
+    int state;
+
     if (rwlock == NULL || (type != RWLOCK_READ && type != RWLOCK_WRITE)) {
         return;
     }
-    mutex_lock(&rwlock->mutex);
     if (type == RWLOCK_WRITE) {
-        rwlock->num_writers++;
-        while (rwlock->type != RWLOCK_FREE && rwlock->curr_readers > 0) {
-            cond_wait(&rwlock->writers, &rwlock->mutex);
+        atomic_add(&rwlock->state, RWLOCK_WRITER_WAITING);
+        while (1) {
+            state = *(volatile int *)&rwlock->state;
+            if ((state & (RWLOCK_READERS_MASK | RWLOCK_WRITER)) == 0) {
+                if (compare_and_swap(&rwlock->state, state, state -
+                                     RWLOCK_WRITER_WAITING + RWLOCK_WRITER) ==
+                    state) {
+                    return;
+                }
+                continue;
+            }
+            thr_park(&rwlock->state, state);
         }
-        rwlock->type = RWLOCK_WRITE;
-    } 
-    else if (type == RWLOCK_READ) {
-        while (rwlock->type == RWLOCK_WRITE || rwlock->num_writers > 0) {
-            cond_wait(&rwlock->readers, &rwlock->mutex);
+    }
+    while (1) {
+        state = *(volatile int *)&rwlock->state;
+        if ((state & (RWLOCK_WRITER | RWLOCK_WAITING_MASK)) == 0) {
+            if (compare_and_swap(&rwlock->state, state, state + 1) == state) {
+                return;
+            }
+            continue;
         }
-        rwlock->curr_readers++;
-        rwlock->type = RWLOCK_READ;
+        thr_park(&rwlock->state, state);
     }
-    mutex_unlock(&rwlock->mutex);
 }
 
 /** @brief unlock the read write lock
  *
- *  If the lock is currently held by a writer and is unlocked we reduce 
- *  the number of writers and set the type to free. We also broadcast to
- *  all readers and signal any thread waiting for a write lock. If there
- *  are other writers waiting for the lock readers promptly go back to sleep
- *  and the signal ensures atleast one writer is awoken if present. If a read
- *  lock is being unlocked, we reduce the number of readers and again broadcast 
- *  to all readers and signal a writer. We broadcast to all readers since we 
- *  allow multiple readers to acquire the lock.
+ *  If the lock is currently held by a writer we clear the writer bit and
+ *  unpark everybody waiting on the lock. Readers go back to sleep if other
+ *  writers are waiting, and only one of the waiting writers gets the lock.
+ *  If a read lock is being unlocked, we reduce the number of readers and
+ *  unpark the waiting threads once the last reader is gone.
  *
  *  @param rwlock the rwlock to unlock
  *  @return void
  */
 void rwlock_unlock(rwlock_t *rwlock) {
+    int state;
+
     if (rwlock == NULL) {
         return;
     }
-    mutex_lock(&rwlock->mutex);
-    if (rwlock->type == RWLOCK_WRITE) {
-        rwlock->num_writers--;
-        rwlock->type = RWLOCK_FREE;
-        cond_broadcast(&rwlock->readers);
-        cond_signal(&rwlock->writers);
+    state = *(volatile int *)&rwlock->state;
+    if (state & RWLOCK_WRITER) {
+        atomic_add(&rwlock->state, -RWLOCK_WRITER);
+        thr_unpark_all(&rwlock->state);
     } 
-    else if (rwlock->type == RWLOCK_READ) { 
-        rwlock->curr_readers--;
-        if (rwlock->curr_readers == 0) {
-            rwlock->type = RWLOCK_FREE;
-            cond_broadcast(&rwlock->readers);
-            cond_signal(&rwlock->writers);
+    else if (state & RWLOCK_READERS_MASK) { 
+        state = atomic_add(&rwlock->state, -1);
+        if ((state & RWLOCK_READERS_MASK) == 1) {
+            thr_unpark_all(&rwlock->state);
         }
     }
-    mutex_unlock(&rwlock->mutex);
 }
 
 /** @brief destroy the read write lock
  *
- *  Invalidate the lock by setting the type to an invalid value.
+ *  The lock holds no resources, so there is nothing to reclaim. Destroying
+ *  a lock which is held or waited for panics.
  *
- *  @param rwlock the rwlock to unlock
+ *  @param rwlock the rwlock to destroy
  *  @return void
  */
 void rwlock_destroy(rwlock_t *rwlock ) {
-    rwlock->type = RWLOCK_INVALID;
-    return;
+    if (rwlock != NULL && *(volatile int *)&rwlock->state != 0) {
+        die("rwlock_destroy() on a rwlock in use");
+    }
 }
 
 /** @brief downgrade the read write lock
  *
  *  This function does nothing if the lock is currently held by a reader.
- *  If it is currently held by a writer we reduce the number of writers 
- *  and broadcast to all readers and make the lock as read. This ensures 
- *  that all the readers currently waiting and the calling thread acquire
- *  the read lock. Future writers have to wait for these readers to release
- *  the lock.
+ *  If it is currently held by a writer we turn the writer into a reader
+ *  and unpark everybody waiting. This lets all the readers currently
+ *  waiting acquire the read lock unless other writers are waiting, in
+ *  which case they have to wait for those writers to get and release it.
  *
  *  @param rwlock the rwlock to unlock
  *  @return void
@@ -127,14 +137,9 @@ void rwlock_downgrade(rwlock_t *rwlock) {
     if (rwlock == NULL) {
         return;
     }
-    mutex_lock(&rwlock->mutex);
-    if (rwlock->type != RWLOCK_WRITE) {
-        mutex_unlock(&rwlock->mutex);
+    if (!(*(volatile int *)&rwlock->state & RWLOCK_WRITER)) {
         return;
     }
-    rwlock->num_writers--;
-    rwlock->curr_readers++;
-    rwlock->type = RWLOCK_READ;
-    cond_broadcast(&rwlock->readers);
-    mutex_unlock(&rwlock->mutex);
+    atomic_add(&rwlock->state, 1 - RWLOCK_WRITER);
+    thr_unpark_all(&rwlock->state);
 }
@@ -1,14 +1,19 @@
 /** @file sem.c
  *  @brief Implementation of semaphores
  *
+ *  The count is taken with a compare and swap and waiters park on it while
+ *  it is 0. A waiter counts itself in waiters before it parks and a
+ *  signaller checks waiters after it has bumped the count, so a signaller
+ *  only looks at the park table when someone may be parked.
+ *
  *  @author Rohit Upadhyaya (rjupadhy)
  *  @author Prajwal Yadapadithaya (pyadapad)
  */
-#include <cond.h>
-#include <mutex.h>
 #include <sem.h>
-#include <simics.h>
-#define RWLOCK_FREE 2
+#include <asm.h>
+#include <park.h>
+#include <stddef.h>
+#include <panic.h>
 
 /** @brief This function will initialize a semaphore to
  * 	a given value count. 
@@ -21,10 +26,8 @@ int sem_init(sem_t *sem, int count) {
 	if(sem == NULL || count <= 0) {
 		return -1;
 	}
-	mutex_init(&sem->mutex);
-	cond_init(&sem->cond_var);
 	sem->count = count;
-	sem->valid = 1;
+	sem->waiters = 0;
 	return 0;
 }
 
@@ -37,15 +40,23 @@ int sem_init(sem_t *sem, int count) {
  * @return Void
  */
 void sem_wait(sem_t *sem) {
-    if (sem == NULL || (!sem->valid)) {
+    int count;
+
+    if (sem == NULL) {
         return;
     }
-    mutex_lock(&sem->mutex);
-	while(sem->count == 0) {
-		cond_wait(&sem->cond_var, &sem->mutex);
-	}
-	sem->count--;
-    mutex_unlock(&sem->mutex);
+    while (1) {
+        count = *(volatile int *)&sem->count;
+        if (count > 0) {
+            if (compare_and_swap(&sem->count, count, count - 1) == count) {
+                return;
+            }
+            continue;
+        }
+        atomic_add(&sem->waiters, 1);
+        thr_park(&sem->count, 0);
+        atomic_add(&sem->waiters, -1);
+    }
 }
 
 /**
@@ -57,22 +68,26 @@ void sem_wait(sem_t *sem) {
  * @return Void
  */
 void sem_signal(sem_t *sem) {
-    if (sem == NULL || (!sem->valid)) {
+    if (sem == NULL) {
         return;
     }
-    mutex_lock(&sem->mutex);
-	sem->count++;
-	cond_signal(&sem->cond_var);
-    mutex_unlock(&sem->mutex);
+    atomic_add(&sem->count, 1);
+    if (atomic_add(&sem->waiters, 0) > 0) {
+        thr_unpark_one(&sem->count);
+    }
 }
 
 /**
  * @brief Function to deactivate a semaphore.
  *
+ * The semaphore holds no resources, so there is nothing to reclaim.
+ * Destroying a semaphore which threads are parked on panics.
+ *
  * @param sem Semaphore which needs to be deactivated
  * @return Void
  */
 void sem_destroy(sem_t *sem) {
-    sem->valid = 0;
-    return;
+    if (sem != NULL && atomic_add(&sem->waiters, 0) != 0) {
+        die("sem_destroy() on a semaphore with waiters");
+    }
 }
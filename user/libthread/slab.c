@@ -0,0 +1,175 @@
+/** @file slab.c
+ *  @brief Implementation of object caches
+ *
+ *  A slab is KMEM_SLAB_SIZE bytes, or as many pages as a single object
+ *  needs if that does not fit, mapped with page_alloc. Being page aligned,
+ *  it is aligned for any object alignment up to PAGE_SIZE. Its first word
+ *  links it into the list of slabs of the cache. The rest, from the first
+ *  aligned address at least 8 bytes in, is cut into objects which all go
+ *  onto the free list of the cache. Slabs are only given back, to the
+ *  kernel, when the cache is destroyed.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <slab.h>
+#include <mutex.h>
+#include <malloc.h>
+#include <syscall.h>
+#include <errors.h>
+#include <stddef.h>
+#include <thr_internals.h>
+
+#define ROUND_UP(n, to) (((n) + (to) - 1) & ~((to) - 1))
+#define SLAB_HEADER 8   /* Slab link, padded to keep objects aligned */
+#define SLAB_FIRST(cache) KMEM_OBJ_SIZE(SLAB_HEADER, (cache)->align)
+
+static int slab_grow(kmem_cache_t *cache);
+
+/** @brief initialize an object cache
+ *
+ *  @param cache the cache
+ *  @param size the size of the objects
+ *  @param ctor function run on every object when it is carved from a new
+ *         slab, may be NULL
+ *  @return 0 on success, ERR_INVAL for a bad cache or size
+ */
+int kmem_cache_init(kmem_cache_t *cache, unsigned int size,
+                    void (*ctor)(void *)) {
+    return kmem_cache_init_aligned(cache, size, 8, ctor);
+}
+
+/** @brief initialize an object cache whose objects are aligned
+ *
+ *  @param cache the cache
+ *  @param size the size of the objects
+ *  @param align the alignment of the objects, a power of 2, at least 8 and
+ *         at most PAGE_SIZE
+ *  @param ctor function run on every object when it is carved from a new
+ *         slab, may be NULL
+ *  @return 0 on success, ERR_INVAL for a bad cache, size or alignment
+ */
+int kmem_cache_init_aligned(kmem_cache_t *cache, unsigned int size,
+                            unsigned int align, void (*ctor)(void *)) {
+    if (cache == NULL || size == 0 || align < 8 || align > PAGE_SIZE ||
+        (align & (align - 1))) {
+        return ERR_INVAL;
+    }
+    cache->size = KMEM_OBJ_SIZE(size, align);
+    cache->align = align;
+    cache->ctor = ctor;
+    cache->free = NULL;
+    cache->slabs = NULL;
+    cache->created = 0;
+    return mutex_init(&cache->lock);
+}
+
+/** @brief allocate and initialize an object cache
+ *
+ *  @param size the size of the objects
+ *  @param ctor function run on every object when it is carved from a new
+ *         slab, may be NULL
+ *  @return the cache, NULL on failure
+ */
+kmem_cache_t *kmem_cache_create(unsigned int size, void (*ctor)(void *)) {
+    kmem_cache_t *cache = malloc(sizeof(kmem_cache_t));
+
+    if (cache == NULL) {
+        return NULL;
+    }
+    if (kmem_cache_init(cache, size, ctor) < 0) {
+        free(cache);
+        return NULL;
+    }
+    cache->created = 1;
+    return cache;
+}
+
+/** @brief allocate an object
+ *
+ *  @param cache the cache
+ *  @return the object, in its constructed state, NULL if out of memory
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    void *obj;
+
+    mutex_lock(&cache->lock);
+    if (cache->free == NULL && slab_grow(cache) < 0) {
+        mutex_unlock(&cache->lock);
+        return NULL;
+    }
+    obj = cache->free;
+    cache->free = *(void **)obj;
+    mutex_unlock(&cache->lock);
+    return obj;
+}
+
+/** @brief free an object
+ *
+ *  @param cache the cache the object was allocated from
+ *  @param obj the object, in its constructed state
+ *  @return void
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    if (obj == NULL) {
+        return;
+    }
+    mutex_lock(&cache->lock);
+    *(void **)obj = cache->free;
+    cache->free = obj;
+    mutex_unlock(&cache->lock);
+}
+
+/** @brief give back all slabs of a cache
+ *
+ *  All objects of the cache become invalid. The cache itself is freed
+ *  only if it came from kmem_cache_create.
+ *
+ *  @param cache the cache
+ *  @return void
+ */
+void kmem_cache_destroy(kmem_cache_t *cache) {
+    void *slab;
+
+    mutex_lock(&cache->lock);
+    while ((slab = cache->slabs) != NULL) {
+        cache->slabs = *(void **)slab;
+        page_free(slab);
+    }
+    cache->free = NULL;
+    mutex_unlock(&cache->lock);
+    mutex_destroy(&cache->lock);
+    if (cache->created) {
+        free(cache);
+    }
+}
+
+/** @brief add a slab to a cache
+ *
+ *  Must be called with the lock of the cache held.
+ *
+ *  @param cache the cache
+ *  @return 0 on success, ERR_NOMEM if out of memory
+ */
+static int slab_grow(kmem_cache_t *cache) {
+    unsigned int slab_size = KMEM_SLAB_SIZE;
+    char *slab, *obj;
+
+    if (SLAB_FIRST(cache) + cache->size > slab_size) {
+        slab_size = ROUND_UP(SLAB_FIRST(cache) + cache->size, PAGE_SIZE);
+    }
+    if ((slab = page_alloc(slab_size)) == NULL) {
+        return ERR_NOMEM;
+    }
+    *(void **)slab = cache->slabs;
+    cache->slabs = slab;
+    for (obj = slab + SLAB_FIRST(cache); obj + cache->size <= slab + slab_size;
+         obj += cache->size) {
+        if (cache->ctor != NULL) {
+            cache->ctor(obj);
+        }
+        *(void **)obj = cache->free;
+        cache->free = obj;
+    }
+    return 0;
+}
@@ -0,0 +1,287 @@
+/** @file spsc.c
+ *  @brief Implementation of single producer, single consumer rings
+ *
+ *  The producer owns the tail and the consumer owns the head, and each
+ *  sits on its own cache line along with a cached copy of the other
+ *  index. A side only reads the other side's index when its cached copy
+ *  says the ring is full (or empty), so in the steady state the two
+ *  threads do not share any cache line but the ones holding the items.
+ *  The items are written before the index that publishes them, and read
+ *  before the index that frees them.
+ *
+ *  In blocking mode a consumer about to park publishes its tid in the
+ *  waiter field and takes a last look at the tail. The producer reads the
+ *  waiter field with a locked instruction after it has published new
+ *  items, and claims it with a compare and swap before waking the
+ *  consumer up. A consumer that fails to take its tid back has been
+ *  claimed, and waits for its reject flag before it goes on, so the
+ *  producer is done with it before it can park again or go away.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <spsc.h>
+#include <thread.h>
+#include <asm.h>
+#include <syscall.h>
+#include <errors.h>
+#include <malloc.h>
+#include <string.h>
+
+#define LOAD(x) (*(volatile unsigned int *)&(x))
+
+static void ring_copy_in(spsc_t *q, unsigned int pos, const char *items,
+                         int n);
+static void ring_copy_out(spsc_t *q, unsigned int pos, char *items, int n);
+static void spsc_wake(spsc_t *q);
+
+/** @brief initialize a ring
+ *
+ *  The capacity is rounded up to a power of two.
+ *
+ *  @param q the ring
+ *  @param capacity number of items the ring can hold
+ *  @param elem_size size of an item in bytes
+ *  @param flags SPSC_BLOCKING to allow spsc_pop_wait, 0 otherwise
+ *  @return 0 on success, negative error code on failure
+ */
+int spsc_init(spsc_t *q, int capacity, int elem_size, int flags) {
+    unsigned int size = 1;
+
+    if (q == NULL || capacity <= 0 || elem_size <= 0) {
+        return ERR_INVAL;
+    }
+    while (size < capacity) {
+        size <<= 1;
+    }
+    q->buf = (char *)malloc(size * elem_size);
+    if (q->buf == NULL) {
+        return ERR_NOMEM;
+    }
+    q->mask = size - 1;
+    q->elem_size = elem_size;
+    q->head = q->tail = 0;
+    q->head_cache = q->tail_cache = 0;
+    q->blocking = (flags & SPSC_BLOCKING) != 0;
+    q->waiter = 0;
+    q->reject = 0;
+    q->green = NULL;
+    return 0;
+}
+
+/** @brief push an item, producer only
+ *
+ *  @param q the ring
+ *  @param item the item to copy into the ring
+ *  @return 0 on success, ERR_BUSY if the ring is full, ERR_INVAL for
+ *          invalid input
+ */
+int spsc_push(spsc_t *q, const void *item) {
+    int ret = spsc_push_bulk(q, item, 1);
+    if (ret == 0) {
+        return ERR_BUSY;
+    }
+    return (ret < 0) ? ret : 0;
+}
+
+/** @brief pop an item, consumer only
+ *
+ *  @param q the ring
+ *  @param item where to copy the item to
+ *  @return 0 on success, ERR_BUSY if the ring is empty, ERR_INVAL for
+ *          invalid input
+ */
+int spsc_pop(spsc_t *q, void *item) {
+    int ret = spsc_pop_bulk(q, item, 1);
+    if (ret == 0) {
+        return ERR_BUSY;
+    }
+    return (ret < 0) ? ret : 0;
+}
+
+/** @brief push as many of n items as there is room for, producer only
+ *
+ *  @param q the ring
+ *  @param items array of n items
+ *  @param n number of items
+ *  @return number of items pushed, ERR_INVAL for invalid input
+ */
+int spsc_push_bulk(spsc_t *q, const void *items, int n) {
+    unsigned int tail, room;
+
+    if (q == NULL || q->buf == NULL || items == NULL || n < 0) {
+        return ERR_INVAL;
+    }
+    tail = q->tail;
+    room = q->mask + 1 - (tail - q->head_cache);
+    if (room < n) {
+        q->head_cache = LOAD(q->head);
+        compiler_barrier();
+        room = q->mask + 1 - (tail - q->head_cache);
+    }
+    if (n > room) {
+        n = room;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    ring_copy_in(q, tail, items, n);
+    compiler_barrier();
+    LOAD(q->tail) = tail + n;
+    if (q->blocking) {
+        spsc_wake(q);
+    }
+    return n;
+}
+
+/** @brief pop up to n items, consumer only
+ *
+ *  @param q the ring
+ *  @param items array of room for n items
+ *  @param n maximum number of items
+ *  @return number of items popped, ERR_INVAL for invalid input
+ */
+int spsc_pop_bulk(spsc_t *q, void *items, int n) {
+    unsigned int head, avail;
+
+    if (q == NULL || q->buf == NULL || items == NULL || n < 0) {
+        return ERR_INVAL;
+    }
+    head = q->head;
+    avail = q->tail_cache - head;
+    if (avail < n) {
+        q->tail_cache = LOAD(q->tail);
+        compiler_barrier();
+        avail = q->tail_cache - head;
+    }
+    if (n > avail) {
+        n = avail;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    ring_copy_out(q, head, items, n);
+    compiler_barrier();
+    LOAD(q->head) = head + n;
+    return n;
+}
+
+/** @brief pop up to n items, waiting for one if the ring is empty
+ *
+ *  Consumer only, and only for rings initialized with SPSC_BLOCKING.
+ *
+ *  @param q the ring
+ *  @param items array of room for n items
+ *  @param n maximum number of items
+ *  @return number of items popped, ERR_INVAL for invalid input
+ */
+int spsc_pop_wait(spsc_t *q, void *items, int n) {
+    int tid, k;
+
+    if (q == NULL || !q->blocking || n <= 0) {
+        return ERR_INVAL;
+    }
+    tid = thr_getid();
+    while ((k = spsc_pop_bulk(q, items, n)) == 0) {
+        q->reject = 0;
+        q->green = green_self();
+        compare_and_swap(&q->waiter, 0, tid);   /* Publish before looking */
+        if (LOAD(q->tail) == q->head) {
+            if (q->green != NULL) {
+                green_sleep(q->green, &q->reject);
+            }
+            else {
+                deschedule(&q->reject);
+            }
+        }
+        if (compare_and_swap(&q->waiter, tid, 0) == tid) {
+            continue;
+        }
+        /* Claimed, the producer is about to set our flag */
+        while (!*(volatile int *)&q->reject) {
+            if (q->green != NULL) {
+                green_sleep(q->green, &q->reject);
+            }
+            else {
+                deschedule(&q->reject);
+            }
+        }
+    }
+    return k;
+}
+
+/** @brief destroy a ring
+ *
+ *  @pre neither side is using the ring
+ *  @param q the ring
+ *  @return void
+ */
+void spsc_destroy(spsc_t *q) {
+    if (q == NULL || q->buf == NULL) {
+        return;
+    }
+    free(q->buf);
+    q->buf = NULL;
+}
+
+/** @brief copy n items into the ring starting at position pos
+ *
+ *  @param q the ring
+ *  @param pos first position
+ *  @param items the items
+ *  @param n number of items
+ *  @return void
+ */
+static void ring_copy_in(spsc_t *q, unsigned int pos, const char *items,
+                         int n) {
+    unsigned int first = pos & q->mask;
+    unsigned int upto_end = q->mask + 1 - first;
+
+    if (n <= upto_end) {
+        memcpy(q->buf + first * q->elem_size, items, n * q->elem_size);
+        return;
+    }
+    memcpy(q->buf + first * q->elem_size, items, upto_end * q->elem_size);
+    memcpy(q->buf, items + upto_end * q->elem_size,
+           (n - upto_end) * q->elem_size);
+}
+
+/** @brief copy n items out of the ring starting at position pos
+ *
+ *  @param q the ring
+ *  @param pos first position
+ *  @param items where to copy the items to
+ *  @param n number of items
+ *  @return void
+ */
+static void ring_copy_out(spsc_t *q, unsigned int pos, char *items, int n) {
+    unsigned int first = pos & q->mask;
+    unsigned int upto_end = q->mask + 1 - first;
+
+    if (n <= upto_end) {
+        memcpy(items, q->buf + first * q->elem_size, n * q->elem_size);
+        return;
+    }
+    memcpy(items, q->buf + first * q->elem_size, upto_end * q->elem_size);
+    memcpy(items + upto_end * q->elem_size, q->buf,
+           (n - upto_end) * q->elem_size);
+}
+
+/** @brief wake the consumer up if it is parked in spsc_pop_wait
+ *
+ *  @param q the ring
+ *  @return void
+ */
+static void spsc_wake(spsc_t *q) {
+    int tid = atomic_add(&q->waiter, 0);
+
+    if (tid != 0 && compare_and_swap(&q->waiter, tid, 0) == tid) {
+        if (q->green != NULL) {
+            green_wakeup(q->green, &q->reject);
+        }
+        else {
+            q->reject = 1;
+            make_runnable(tid);
+        }
+    }
+}
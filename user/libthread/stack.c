@@ -0,0 +1,152 @@
+/** @file stack.c
+ *  @brief Allocator of thread stacks
+ *
+ *  The region for thread stacks starts AUTOSTACK_MAIN_RESERVE below the
+ *  top of the main thread's stack, which is capped to grow no further, and
+ *  extends down from there. Slots are handed out top down and reused once
+ *  the thread on them has been joined. The top of every slot is the
+ *  exception stack of its thread. The lowest page of every slot is
+ *  never committed, so a thread running off its stack faults instead of
+ *  scribbling over the stack below.
+ *
+ *  Since slots are size aligned, the slot a thread runs on, and with it
+ *  its autostack_t, follows from its stack pointer.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <stack.h>
+#include <mutex.h>
+#include <syscall.h>
+#include <errors.h>
+#include <stddef.h>
+
+static char *region_top;            /* Top of the highest slot */
+static unsigned int slot_size;      /* Power of 2 */
+static int nslots;
+static int next_slot;               /* Slots from here on were never used */
+static int free_slots[STACK_MAX_SLOTS];
+static int nfree;
+static autostack_t *slot_stacks[STACK_MAX_SLOTS];
+static mutex_t slot_lock = MUTEX_INITIALIZER;
+
+static int slot_of(char *addr);
+
+/** @brief lay out the region for thread stacks
+ *
+ *  Called by thr_init. Also caps the growth of the main thread's stack.
+ *
+ *  @param size the stack size thr_init was asked for
+ *  @return 0 on success, ERR_INVAL if size does not fit the region
+ */
+int stack_init(unsigned int size) {
+    char *top = main_stack.high - AUTOSTACK_MAIN_RESERVE;
+
+    slot_size = STACK_SLOT_MIN;
+    while (slot_size < size + PAGE_SIZE + EXCEPTION_STACK_SIZE) {
+        if (slot_size == STACK_REGION_SIZE) {
+            return ERR_INVAL;
+        }
+        slot_size <<= 1;
+    }
+    if (top > main_stack.low - PAGE_SIZE) {
+        top = main_stack.low - PAGE_SIZE;
+    }
+    region_top = (char *)((unsigned int)top & ~(slot_size - 1));
+    nslots = STACK_REGION_SIZE / slot_size;
+    next_slot = 0;
+    nfree = 0;
+    main_stack.limit = region_top + PAGE_SIZE;
+    autostack_locate = stack_self;
+    return 0;
+}
+
+/** @brief give a new thread a stack
+ *
+ *  Only the top page of the stack is committed. It holds the exception
+ *  stack of the thread, right above where the thread starts its stack.
+ *
+ *  @param as the stack to set up
+ *  @return 0 on success, ERR_NOMEM if we are out of slots or memory
+ */
+int stack_alloc(autostack_t *as) {
+    char *base;
+    int slot;
+
+    mutex_lock(&slot_lock);
+    if (nfree > 0) {
+        slot = free_slots[--nfree];
+    }
+    else if (next_slot < nslots) {
+        slot = next_slot++;
+    }
+    else {
+        mutex_unlock(&slot_lock);
+        return ERR_NOMEM;
+    }
+    slot_stacks[slot] = as;
+    mutex_unlock(&slot_lock);
+
+    base = region_top - (slot + 1) * slot_size;
+    as->high = base + slot_size;
+    as->low = as->high;
+    as->limit = base + PAGE_SIZE;
+    as->peak = as->high;
+    as->floor = as->high;
+    as->trimmed_at = 0;
+    as->lock = 0;
+    as->nchunks = 0;
+    as->exception_stack = as->high - EXCEPTION_STACK_SIZE;
+    if (autostack_commit(as, as->high - PAGE_SIZE) < 0) {
+        stack_free(as);
+        return ERR_NOMEM;
+    }
+    return 0;
+}
+
+/** @brief give back the stack of a thread
+ *
+ *  @param as the stack, which no thread may be running on
+ *  @return void
+ */
+void stack_free(autostack_t *as) {
+    int slot = slot_of(as->high - 1);
+
+    autostack_release(as);
+    mutex_lock(&slot_lock);
+    slot_stacks[slot] = NULL;
+    free_slots[nfree++] = slot;
+    mutex_unlock(&slot_lock);
+}
+
+/** @brief get the size of the slots
+ *
+ *  @return the size of a slot in bytes, 0 before stack_init
+ */
+unsigned int stack_slot_size(void) {
+    return slot_size;
+}
+
+/** @brief find the stack of the calling thread
+ *
+ *  @return the stack, NULL if the calling thread does not run on a slot
+ */
+autostack_t *stack_self(void) {
+    char here;
+    int slot = slot_of(&here);
+
+    return (slot < 0) ? NULL : slot_stacks[slot];
+}
+
+/** @brief find the slot holding an address
+ *
+ *  @param addr the address
+ *  @return the slot, -1 if addr is not in the region
+ */
+static int slot_of(char *addr) {
+    if (region_top == NULL || addr >= region_top ||
+        addr < region_top - nslots * slot_size) {
+        return -1;
+    }
+    return (region_top - 1 - addr) / slot_size;
+}
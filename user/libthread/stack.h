@@ -0,0 +1,26 @@
+/** @file stack.h
+ *  @brief Interface to the allocator of thread stacks
+ *
+ *  Thread stacks live in equally sized, size aligned slots of a region
+ *  below the main thread's stack. Every slot is an autostack_t which only
+ *  has its top page committed when the thread starts.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+
+#ifndef __STACK_H
+#define __STACK_H
+#include <autostack.h>
+
+#define STACK_SLOT_MIN (1024 * 1024)            /* Range reserved per thread */
+#define STACK_REGION_SIZE (1024 * 1024 * 1024)  /* Range for all threads */
+#define STACK_MAX_SLOTS (STACK_REGION_SIZE / STACK_SLOT_MIN)
+
+int stack_init(unsigned int size);
+int stack_alloc(autostack_t *as);
+void stack_free(autostack_t *as);
+autostack_t *stack_self(void);
+unsigned int stack_slot_size(void);
+
+#endif /* __STACK_H */
@@ -5,7 +5,10 @@
 #ifndef __TCB_H
 #define __TCB_H
 #include <list.h>
+#include <mutex_type.h>
 #include <cond_type.h>
+#include <tsd.h>
+#include <stack.h>
 
 
 /** @brief a type for task control blocks.
@@ -18,11 +21,14 @@
 typedef struct tcb {
     int id;
 	int exited;
-	void *stack_base;
+	autostack_t stack;      /* Unused for the main thread */
+	int stack_done;         /* Set once the thread is off its stack */
+	int exiting;            /* Set once its destructors have started */
 	void *status;
     list_head tcb_list;
     cond_t waiting_threads;   /* For threads joining on this thread */
 	mutex_t tcb_mutex;
+	void *specific[THR_KEYS_MAX];  /* Thread specific data, by key */
 } tcb_t;
 
 #endif /* __TCB_H */
@@ -10,4 +10,31 @@
 
 void new_thread_init(void *(*func_addr)(void *), void *arg);
 
+/* Per thread malloc caches */
+int malloc_cache_init(void);
+
+/* Malloc profiler hooks, called when mprof_rate or mprof_nlive is set */
+extern unsigned int mprof_rate;
+extern int mprof_nlive;
+void mprof_alloc(void *ptr, unsigned int size, void *site);
+void mprof_free(void *ptr);
+
+/* Pages mapped outside the heap */
+void *page_alloc(unsigned int len);
+void page_free(void *pages);
+
+/* Thread specific data */
+struct tcb;
+struct tcb *current_tcb(void);
+void tsd_run_destructors(struct tcb *tcb);
+int tsd_exiting(void);
+
+/* Hooks letting the blocking primitives park green threads */
+struct green_thread;
+struct green_thread *green_self(void);
+struct tcb *green_tcb(struct green_thread *g);
+void green_sleep(struct green_thread *g, int *flag);
+void green_wakeup(struct green_thread *g, int *flag);
+void green_yield(void);
+
 #endif /* THR_INTERNALS_H */
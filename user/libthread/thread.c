@@ -17,6 +17,11 @@
 #include <autostack.h>
 #include <contracts.h>
 #include <thr_internals.h>
+#include <pool.h>
+#include <stack.h>
+#include <stackmon.h>
+#include <simics.h>
+#include <slab.h>
 
 #define TRUE 1
 #define FALSE 0
@@ -24,24 +29,35 @@
 
 #define STACK_PADDING(size) ((((size)%4)==0)?0:(4-((size)%4)))
 
+#define TCB_BUCKETS 64      /* Power of 2 */
+#define TCB_BUCKET(tid) (&tcb_table[(tid) & (TCB_BUCKETS - 1)])
+
 static unsigned int stack_size;
-static tcb_t head;
+static list_head tcb_table[TCB_BUCKETS];   /* TCBs hashed by tid */
+static int live_threads;    /* Threads which have not called thr_exit */
+static unsigned int joined_peak;    /* Most stack used by a joined thread */
+static tcb_t *main_tcb;     /* TCB of the thread which called thr_init */
+static int main_tid;
 
-static mutex_t tcb_lock;
+static mutex_t tcb_lock = MUTEX_INITIALIZER;
 
 /*Helper functions*/
 static tcb_t *find_tcb(int tid);
 static void remove_tcb(tcb_t *tcb);
 static void add_tcb(int tid, tcb_t *tcb);
-static tcb_t *init_tcb(void *stack_base);
+static tcb_t *init_tcb(void);
+static void tcb_ctor(void *obj);
+
+static kmem_cache_t tcb_cache = KMEM_CACHE_INITIALIZER(sizeof(tcb_t), tcb_ctor);
 
 /** @brief This function is responsible for initializing the
  *  thread library.
  *
- *  In a multi threaded environment we do not support growing the stack.
- *  So we first uninstall the software exception handler which grows the stack
- *  in a single threaded environment. This function can be called only by one
- *  thread at a time and only once per process.
+ *  The main thread keeps growing its stack, but only down to the region
+ *  where the stacks of other threads are placed. Every other thread gets
+ *  a range of at least size bytes of which only the top is committed, and
+ *  grows its stack within that range. This function can be called only by
+ *  one thread at a time and only once per process.
  *
  *  @param size Size of the stack space available for each thread
  * 
@@ -50,20 +66,28 @@ static tcb_t *init_tcb(void *stack_base);
 int thr_init(unsigned int size) {
     int ret_val;
 
-    uninstall_seh();
     stack_size = size + STACK_PADDING(size);
-	ret_val = mutex_init(&tcb_lock);
-    if (ret_val < 0) {
+    if ((ret_val = stack_init(stack_size)) < 0) {
+        return ret_val;
+    }
+    int i;
+    for (i = 0; i < TCB_BUCKETS; i++) {
+        init_head(&tcb_table[i]);
+    }
+    if ((ret_val = pool_init()) < 0) {
         return ret_val;
     }
-    init_head(&head.tcb_list);
     tcb_t *tcb;
-    if ((tcb = init_tcb(NULL)) == NULL) {
+    if ((tcb = init_tcb()) == NULL) {
         return ERR_INVAL;
     }
 
 	/*Add the current thread to the TCB list*/
 	add_tcb(thr_getid(), tcb);
+	live_threads = 1;
+	main_tid = tcb->id;
+	main_tcb = tcb;
+	malloc_cache_init();    /* Without caches malloc just takes the mutex */
 
 	return 0;
 }
@@ -79,17 +103,24 @@ int thr_init(unsigned int size) {
  *  new thread is returned. Otherwise, a negative value is returned.
  */
 int thr_create(void *(*func)(void *), void *arg) {
-    char *stack_base = ((char *)malloc(stack_size));
-    if (stack_base == NULL) {
-        return ERR_NOMEM;
-    }
     tcb_t *tcb;
-    if ((tcb = init_tcb(NULL)) == NULL) {
+    if ((tcb = init_tcb()) == NULL) {
         return ERR_INVAL;
+    }
+    if (stack_alloc(&tcb->stack) < 0) {
+		kmem_cache_free(&tcb_cache, tcb);
+        return ERR_NOMEM;
     }
 	mutex_lock(&tcb_lock); /*Lock the TCB list for adding a TCB entry*/
-	int tid = thread_fork((stack_base + stack_size), func, arg);
+	int tid = thread_fork(tcb->stack.exception_stack, func, arg);
+	if (tid < 0) {
+		mutex_unlock(&tcb_lock);
+		stack_free(&tcb->stack);
+		kmem_cache_free(&tcb_cache, tcb);
+		return tid;
+	}
 	add_tcb(tid, tcb);
+	live_threads++;
 	mutex_unlock(&tcb_lock);
 
 	return tid;
@@ -124,8 +155,21 @@ int thr_join(int tid, void **statusp) {
 	if (statusp != NULL) {
     	*statusp = tcb->status;
     }
-	
+	mutex_unlock(&tcb->tcb_mutex);
+
+	/* The thread may still be running on its stack until it vanishes */
+	while (!tcb->stack_done) {
+		yield(tid);
+	}
+
 	mutex_lock(&tcb_lock);
+	if (tcb->stack.high != NULL) {
+		unsigned int used = autostack_usage(&tcb->stack);
+		if (used > joined_peak) {
+			joined_peak = used;
+		}
+		stack_free(&tcb->stack);
+	}
 	remove_tcb(tcb);
 	mutex_unlock(&tcb_lock);
 	
@@ -134,7 +178,9 @@ int thr_join(int tid, void **statusp) {
 
 /** @brief This function exits the thread with exit status.
  *
- *  If the thread does not exist we simply return.
+ *  If the thread does not exist we simply return. Once the only threads
+ *  left are the workers of the thread pool they are told to exit as well,
+ *  so that they do not keep the task alive.
  *  @param status The exit status of the thread.
  *
  *  @return Void 
@@ -144,21 +190,21 @@ void thr_exit(void *status) {
 
 	mutex_lock(&tcb_lock);
 	tcb_t *tcb = find_tcb(tid);
+	int live = --live_threads;
 	mutex_unlock(&tcb_lock);
 
     if (tcb == NULL) { /* Can happen only if called without calling thr_init */
         vanish();
     }
+    pool_release(live);
+    tsd_run_destructors(tcb);
 
 	mutex_lock(&tcb->tcb_mutex);
 	tcb->exited = TRUE;
 	tcb->status = status;
 	cond_signal(&tcb->waiting_threads);
 	mutex_unlock(&tcb->tcb_mutex);
-	if(tcb->stack_base != NULL) {
-		free(tcb->stack_base);
-	}
-	vanish();
+	vanish_and_set(&tcb->stack_done);
 }
 
 /** @brief wrapper function to install exception handler for new thread
@@ -169,7 +215,7 @@ void thr_exit(void *status) {
  *  @return Void
  */
 void new_thread_init(void *(*func_addr)(void *), void *arg) {	
-    install_seh_multi();
+    install_seh_multi(stack_self());
     thr_exit(func_addr(arg));	/* in case thr_exit not called by programmer */
 }
 
@@ -192,16 +238,118 @@ int thr_yield(int tid) {
 	return yield(tid);
 }
 
-/** @brief Function to linearly scan the list of TCBs for the TCB with the
- *         given ID.
+/** @brief Turn painting of new stack pages with STACK_CANARY on or off
+ *
+ *  Turn it on before creating the threads to be measured, the pages
+ *  committed from then on are painted.
+ *
+ *  @param enable nonzero to paint
+ *  @return Void
+ */
+void thr_stack_paint(int enable) {
+	autostack_paint = enable;
+}
+
+/** @brief Function to find how much stack a thread has used so far
+ *
+ *  @param tid Thread ID of a thread which has not been joined
+ *
+ *  @return int The most bytes of stack the thread has used, ERR_INVAL if
+ *  there is no such thread
+ */
+int thr_stack_usage(int tid) {
+	int used = ERR_INVAL;
+
+	mutex_lock(&tcb_lock);
+	tcb_t *tcb = find_tcb(tid);
+	if (tcb != NULL) {
+		used = autostack_usage((tcb->stack.high != NULL) ? &tcb->stack :
+		                       &main_stack);
+	}
+	mutex_unlock(&tcb_lock);
+	return used;
+}
+
+/** @brief Function to log the stack usage of every thread
+ *
+ *  Logs the usage and committed size of the stack of every thread which
+ *  has not been joined, and the peak usage across the process.
+ *
+ *  @return Void
+ */
+void thr_stack_report(void) {
+	unsigned int peak = joined_peak;
+	int i;
+
+	mutex_lock(&tcb_lock);
+	lprintf("stack: %d byte slots, %d byte main stack limit", stack_slot_size(),
+	        main_stack.high - main_stack.limit);
+	for (i = 0; i < TCB_BUCKETS; i++) {
+		list_head *p = get_first(&tcb_table[i]);
+		while (p != NULL && p != &tcb_table[i]) {
+			tcb_t *t = get_entry(p, tcb_t, tcb_list);
+			autostack_t *as = (t->stack.high != NULL) ? &t->stack :
+			                  &main_stack;
+			unsigned int used = autostack_usage(as);
+			lprintf("stack: thread %d used %u committed %u", t->id, used,
+			        as->high - as->low);
+			if (used > peak) {
+				peak = used;
+			}
+			p = p->next;
+		}
+	}
+	mutex_unlock(&tcb_lock);
+	lprintf("stack: peak %u bytes", peak);
+}
+
+/** @brief Function to find the TCB of the calling thread
+ *
+ *  A thread running on its own stack slot finds its TCB from the slot,
+ *  and the main thread, while on the main stack, has its TCB at hand,
+ *  without a system call or taking tcb_lock. Green threads take the TCB
+ *  of their kernel thread from their vproc, just as cheaply.
+ *
+ *  @return tcb_t The TCB of the calling thread, NULL if the thread library
+ *  is not initialized
+ */
+tcb_t *current_tcb(void) {
+	autostack_t *as = stack_self();
+	struct green_thread *g;
+	int tid;
+
+	if (as != NULL) {
+		return get_entry(as, tcb_t, stack);
+	}
+	if ((g = green_self()) != NULL) {
+		return green_tcb(g);
+	}
+	if (main_tcb != NULL && (char *)&as >= main_stack.limit &&
+	    (char *)&as < main_stack.high) {
+		return main_tcb;
+	}
+	tid = thr_getid();
+	if (main_tcb != NULL && tid == main_tid) {
+		return main_tcb;
+	}
+
+	mutex_lock(&tcb_lock);
+	tcb_t *tcb = find_tcb(tid);
+	mutex_unlock(&tcb_lock);
+	return tcb;
+}
+
+/** @brief Function to scan the bucket of the TCB table for the TCB with
+ *         the given ID.
  *
  * @param tid Thread ID
  *
  * @return tcb_t The TCB for the given thread ID
  */
 tcb_t *find_tcb(int tid) {
-	list_head *p = get_first(&head.tcb_list);
-	while(p != NULL && p != &head.tcb_list) {
+	list_head *bucket = TCB_BUCKET(tid);
+	list_head *p = get_first(bucket);
+	while(p != NULL && p != bucket) {
 		tcb_t *t = get_entry(p, tcb_t, tcb_list);
 		if(t->id == tid) {
 			return t;
@@ -216,30 +364,40 @@ tcb_t *find_tcb(int tid) {
  *  Calls to this function are not thread safe and must be protected
  *  by a mutex.
  *
- *  @param stack_base Base address of the stack of the thread.
- *
  *  @return tcb_t * return pointer to an initialized tcb or NULL if it fails
  */
-tcb_t *init_tcb(void *stack_base) {
-	tcb_t *tcb = (tcb_t *)malloc(sizeof(tcb_t));
+tcb_t *init_tcb(void) {
+	tcb_t *tcb = (tcb_t *)kmem_cache_alloc(&tcb_cache);
     if (tcb == NULL) {
         return NULL;
     }
-	tcb->stack_base = stack_base;
+	tcb->stack.high = NULL;
+	tcb->stack_done = FALSE;
 	tcb->exited = FALSE;
-	int cond_ret = cond_init(&tcb->waiting_threads);
-    if (cond_ret < 0) {
-        free(tcb);
-        return NULL;
-    }
-	int mutex_ret = mutex_init(&tcb->tcb_mutex);
-    if (mutex_ret < 0) {
-        free(tcb);
-        return NULL;
-    }
+	tcb->exiting = FALSE;
+	int i;
+	for (i = 0; i < THR_KEYS_MAX; i++) {
+		tcb->specific[i] = NULL;
+	}
     return tcb;
 }
 
+/** @brief Constructor of the TCBs in tcb_cache
+ *
+ *  A TCB goes back to the cache with its mutex unlocked and nobody
+ *  waiting on its cond var, so they need to be initialized only once.
+ *
+ *  @param obj the TCB
+ *
+ *  @return Void
+ */
+static void tcb_ctor(void *obj) {
+	tcb_t *tcb = (tcb_t *)obj;
+
+	cond_init(&tcb->waiting_threads);
+	mutex_init(&tcb->tcb_mutex);
+}
+
 /** @brief Function to add a TCB to the TCB list
  *
  *  Calls to this function are not thread safe and must be protected
@@ -252,7 +410,7 @@ tcb_t *init_tcb(void *stack_base) {
  */
 void add_tcb(int tid, tcb_t *tcb) {
     tcb->id = tid;
-	add_to_tail(&tcb->tcb_list, &head.tcb_list);
+	add_to_tail(&tcb->tcb_list, TCB_BUCKET(tid));
 }
 
 /** @brief Function to remove an entry from the list of TCBs
@@ -262,8 +420,9 @@ void add_tcb(int tid, tcb_t *tcb) {
  *  @return Void
  */
 void remove_tcb(tcb_t *tcb) {	
+	if (tcb == main_tcb) {
+		main_tcb = NULL;
+	}
 	del_entry(&tcb->tcb_list);
-	mutex_destroy(&tcb->tcb_mutex);
-	cond_destroy(&tcb->waiting_threads);
-	free(tcb);
+	kmem_cache_free(&tcb_cache, tcb);
 }
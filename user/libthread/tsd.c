@@ -0,0 +1,114 @@
+/** @file tsd.c
+ *  @brief Implementation of thread specific data
+ *
+ *  Every TCB holds an array of THR_KEYS_MAX slots, so a key is just an
+ *  index into the slots of the calling thread. Keys are handed out in
+ *  order and never reused.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <tsd.h>
+#include <tcb.h>
+#include <asm.h>
+#include <errors.h>
+#include <thr_internals.h>
+
+static void (*key_destructors[THR_KEYS_MAX])(void *);
+static int nkeys = 0;
+
+/** @brief create a key for thread specific data
+ *
+ *  The slot of the new key is NULL in every thread.
+ *
+ *  @param destructor function called with the value of the slot of an
+ *         exiting thread if it is not NULL, may be NULL
+ *  @return the key on success, ERR_NOMEM if all keys are taken
+ */
+int thr_key_create(void (*destructor)(void *)) {
+    int key = atomic_add(&nkeys, 1);
+
+    if (key >= THR_KEYS_MAX) {
+        atomic_add(&nkeys, -1);
+        return ERR_NOMEM;
+    }
+    key_destructors[key] = destructor;
+    return key;
+}
+
+/** @brief set the value of the calling thread's slot of a key
+ *
+ *  @param key the key
+ *  @param value the value
+ *  @return 0 on success, ERR_INVAL for an invalid key or if the library
+ *          is not initialized
+ */
+int thr_setspecific(int key, void *value) {
+    tcb_t *tcb;
+
+    if (key < 0 || key >= THR_KEYS_MAX || key >= nkeys ||
+        (tcb = current_tcb()) == NULL) {
+        return ERR_INVAL;
+    }
+    tcb->specific[key] = value;
+    return 0;
+}
+
+/** @brief get the value of the calling thread's slot of a key
+ *
+ *  @param key the key
+ *  @return the value, NULL if it was never set or the key is invalid
+ */
+void *thr_getspecific(int key) {
+    tcb_t *tcb;
+
+    if (key < 0 || key >= THR_KEYS_MAX || key >= nkeys ||
+        (tcb = current_tcb()) == NULL) {
+        return NULL;
+    }
+    return tcb->specific[key];
+}
+
+/** @brief tell whether the calling thread is running its destructors
+ *
+ *  Lets a library whose destructor has already run avoid setting up its
+ *  slot again for a later destructor.
+ *
+ *  @return nonzero once the destructors of the calling thread started
+ */
+int tsd_exiting(void) {
+    tcb_t *tcb = current_tcb();
+
+    return tcb != NULL && tcb->exiting;
+}
+
+/** @brief run the destructors of the slots of an exiting thread
+ *
+ *  A destructor may set slots again, so we keep going over the keys until
+ *  all slots are NULL, at most THR_DESTRUCTOR_ITERATIONS times.
+ *
+ *  @param tcb the TCB of the exiting thread
+ *  @return void
+ */
+void tsd_run_destructors(tcb_t *tcb) {
+    int pass, key, found;
+    void *value;
+
+    tcb->exiting = 1;
+
+    for (pass = 0; pass < THR_DESTRUCTOR_ITERATIONS; pass++) {
+        found = 0;
+        for (key = 0; key < nkeys && key < THR_KEYS_MAX; key++) {
+            value = tcb->specific[key];
+            if (value == NULL || key_destructors[key] == NULL) {
+                continue;
+            }
+            tcb->specific[key] = NULL;
+            key_destructors[key](value);
+            found = 1;
+        }
+        if (!found) {
+            return;
+        }
+    }
+}
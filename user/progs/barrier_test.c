@@ -0,0 +1,85 @@
+/** @file barrier_test.c
+ *  @brief Test a combining tree barrier over many phases
+ *
+ *  Every thread counts itself into a phase before it waits at the
+ *  barrier, and checks that everybody arrived once it is let through.
+ *  The barrier has more threads than a single node takes, so that the
+ *  release has to walk down a tree.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <thread.h>
+#include <barrier.h>
+#include <asm.h>
+#include <syscall.h>
+#include <simics.h>
+#include <stdlib.h>
+
+#define STACK_SIZE 4096
+#define NR_THREADS 13
+#define NR_PHASES 50
+
+static barrier_t barrier;
+static int arrived[NR_PHASES];
+static int serial[NR_PHASES];
+static int errors = 0;
+
+void *phases(void *arg) {
+    int p, ret;
+
+    for (p = 0; p < NR_PHASES; p++) {
+        atomic_add(&arrived[p], 1);
+        if ((ret = barrier_wait(&barrier)) == BARRIER_SERIAL_THREAD) {
+            atomic_add(&serial[p], 1);
+        }
+        else if (ret != 0) {
+            atomic_add(&errors, 1);
+        }
+        if (*(volatile int *)&arrived[p] != NR_THREADS) {
+            atomic_add(&errors, 1);
+        }
+        if (p % 8 == 0) {
+            yield(-1);
+        }
+    }
+    return NULL;
+}
+
+int main() {
+    int tids[NR_THREADS - 1];
+    int i;
+
+    thr_init(STACK_SIZE);
+
+    if (barrier_init(&barrier, NR_THREADS) < 0) {
+        lprintf("barrier_init failed");
+        exit(1);
+    }
+    for (i = 0; i < NR_THREADS - 1; i++) {
+        if ((tids[i] = thr_create(phases, NULL)) < 0) {
+            lprintf("thr_create failed");
+            exit(1);
+        }
+    }
+    phases(NULL);
+    for (i = 0; i < NR_THREADS - 1; i++) {
+        thr_join(tids[i], NULL);
+    }
+
+    if (errors != 0) {
+        lprintf("A thread left the barrier before everybody arrived");
+        exit(1);
+    }
+    for (i = 0; i < NR_PHASES; i++) {
+        if (serial[i] != 1) {
+            lprintf("Phase %d had %d serial threads", i, serial[i]);
+            exit(1);
+        }
+    }
+    barrier_destroy(&barrier);
+
+    lprintf("barrier_test passed");
+    thr_exit(NULL);
+    return 0;
+}
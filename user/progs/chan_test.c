@@ -0,0 +1,133 @@
+/** @file chan_test.c
+ *  @brief Test channels with several senders and receivers, and closing
+ *         a channel receivers are parked on
+ *
+ *  Every item carries the sender and its sequence number. Each receiver
+ *  checks that the items of a sender reach it in the order they were
+ *  sent, and in the end every item must have been received exactly once.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <thread.h>
+#include <chan.h>
+#include <asm.h>
+#include <errors.h>
+#include <syscall.h>
+#include <simics.h>
+#include <stdlib.h>
+
+#define STACK_SIZE 4096
+#define NR_SENDERS 4
+#define NR_RECEIVERS 4
+#define NR_ITEMS 2000
+#define CAPACITY 8
+
+static chan_t chan;
+static int received[NR_SENDERS];
+static int sums[NR_SENDERS];
+static int errors = 0;
+
+void *sender(void *arg) {
+    int id = (int)arg;
+    int i, item;
+
+    for (i = 0; i < NR_ITEMS; i++) {
+        item = (id << 16) | i;
+        if (chan_send(&chan, &item) < 0) {
+            atomic_add(&errors, 1);
+        }
+    }
+    return NULL;
+}
+
+void *receiver(void *arg) {
+    int last[NR_SENDERS];
+    int i, item, id, seq, ret;
+
+    for (i = 0; i < NR_SENDERS; i++) {
+        last[i] = -1;
+    }
+    while ((ret = chan_recv(&chan, &item)) == 0) {
+        id = item >> 16;
+        seq = item & 0xffff;
+        if (id < 0 || id >= NR_SENDERS || seq <= last[id]) {
+            atomic_add(&errors, 1);
+            continue;
+        }
+        last[id] = seq;
+        atomic_add(&received[id], 1);
+        atomic_add(&sums[id], seq);
+    }
+    return (void *)ret;
+}
+
+int main() {
+    int senders[NR_SENDERS], receivers[NR_RECEIVERS];
+    void *status;
+    int i, item;
+
+    thr_init(STACK_SIZE);
+
+    if (chan_init(&chan, CAPACITY, sizeof(int)) < 0) {
+        lprintf("chan_init failed");
+        exit(1);
+    }
+    for (i = 0; i < NR_RECEIVERS; i++) {
+        receivers[i] = thr_create(receiver, NULL);
+    }
+    for (i = 0; i < NR_SENDERS; i++) {
+        senders[i] = thr_create(sender, (void *)i);
+    }
+    for (i = 0; i < NR_SENDERS; i++) {
+        thr_join(senders[i], NULL);
+    }
+    chan_close(&chan);
+    for (i = 0; i < NR_RECEIVERS; i++) {
+        thr_join(receivers[i], &status);
+        if ((int)status != ERR_CLOSED) {
+            lprintf("Receiver stopped with %d", (int)status);
+            exit(1);
+        }
+    }
+    if (errors != 0) {
+        lprintf("%d items were out of order or failed", errors);
+        exit(1);
+    }
+    for (i = 0; i < NR_SENDERS; i++) {
+        if (received[i] != NR_ITEMS ||
+            sums[i] != NR_ITEMS * (NR_ITEMS - 1) / 2) {
+            lprintf("Sender %d: %d items received", i, received[i]);
+            exit(1);
+        }
+    }
+    chan_destroy(&chan);
+
+    /* Close an empty channel while receivers are parked on it */
+    if (chan_init(&chan, CAPACITY, sizeof(int)) < 0) {
+        lprintf("chan_init failed");
+        exit(1);
+    }
+    for (i = 0; i < NR_RECEIVERS; i++) {
+        receivers[i] = thr_create(receiver, NULL);
+    }
+    sleep(10);
+    chan_close(&chan);
+    for (i = 0; i < NR_RECEIVERS; i++) {
+        thr_join(receivers[i], &status);
+        if ((int)status != ERR_CLOSED) {
+            lprintf("Parked receiver woke up with %d", (int)status);
+            exit(1);
+        }
+    }
+    item = 0;
+    if (chan_send(&chan, &item) != ERR_CLOSED) {
+        lprintf("chan_send succeeded on a closed channel");
+        exit(1);
+    }
+    chan_destroy(&chan);
+
+    lprintf("chan_test passed");
+    thr_exit(NULL);
+    return 0;
+}
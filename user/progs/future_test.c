@@ -0,0 +1,81 @@
+/** @file future_test.c
+ *  @brief Test futures, continuations and future_wait_any
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <thread.h>
+#include <future.h>
+#include <syscall.h>
+#include <simics.h>
+#include <stdlib.h>
+
+#define STACK_SIZE 4096
+#define NR_FUTURES 16
+
+void *square(void *arg) {
+    int n = (int)arg;
+    return (void *)(n * n);
+}
+
+void *slow_square(void *arg) {
+    sleep(10);
+    return square(arg);
+}
+
+void *increment(void *arg) {
+    return (void *)((int)arg + 1);
+}
+
+int main() {
+    future_t *futures[NR_FUTURES];
+    future_t *then;
+    void *value;
+    int i, sum = 0;
+
+    thr_init(STACK_SIZE);
+
+    for (i = 0; i < NR_FUTURES; i++) {
+        if ((futures[i] = async(square, (void *)i)) == NULL) {
+            lprintf("async failed");
+            exit(1);
+        }
+    }
+    for (i = 0; i < NR_FUTURES; i++) {
+        sum += (int)future_get(futures[i]);
+        future_destroy(futures[i]);
+    }
+    if (sum != 1240) {
+        lprintf("Wrong sum of squares %d", sum);
+        exit(1);
+    }
+
+    futures[0] = async(slow_square, (void *)3);
+    then = future_then(futures[0], increment);
+    if (future_try_get(then, &value) == 0) {
+        lprintf("Continuation ran before its parent");
+        exit(1);
+    }
+    if ((int)future_get(then) != 10) {
+        lprintf("Wrong continuation value");
+        exit(1);
+    }
+    future_destroy(then);
+    future_destroy(futures[0]);
+
+    futures[0] = async(slow_square, (void *)2);
+    futures[1] = async(square, (void *)5);
+    i = future_wait_any(futures, 2);
+    if (i < 0 || future_try_get(futures[i], &value) < 0) {
+        lprintf("future_wait_any returned a future which is not ready");
+        exit(1);
+    }
+    future_get(futures[0]);
+    future_get(futures[1]);
+    future_destroy(futures[0]);
+    future_destroy(futures[1]);
+
+    lprintf("future_test passed");
+    thr_exit(NULL);
+    return 0;
+}
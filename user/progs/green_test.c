@@ -0,0 +1,73 @@
+/** @file green_test.c
+ *  @brief Test green threads blocking on mutexes and cond vars
+ *
+ *  Far more green threads than the kernel would let us create are spawned
+ *  onto two kernel threads. Each one bumps a shared counter under a mutex
+ *  and then waits on a cond var until everybody has done so, which only
+ *  works if waiting parks the green thread and not its kernel thread.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <thread.h>
+#include <green.h>
+#include <mutex.h>
+#include <cond.h>
+#include <simics.h>
+#include <stdlib.h>
+
+#define STACK_SIZE 4096
+#define GREEN_STACK_SIZE 2048
+#define NR_KTHREADS 2
+#define NR_GREEN 2000
+
+mutex_t lock;
+cond_t everybody_in;
+int arrived = 0;
+green_t *threads[NR_GREEN];
+
+void *worker(void *arg) {
+    mutex_lock(&lock);
+    arrived++;
+    if (arrived == NR_GREEN) {
+        cond_broadcast(&everybody_in);
+    }
+    while (arrived < NR_GREEN) {
+        cond_wait(&everybody_in, &lock);
+    }
+    mutex_unlock(&lock);
+    green_yield();
+    return arg;
+}
+
+int main() {
+    void *status;
+    int i;
+
+    thr_init(STACK_SIZE);
+    mutex_init(&lock);
+    cond_init(&everybody_in);
+
+    if (green_init(NR_KTHREADS, GREEN_STACK_SIZE) < 0) {
+        lprintf("green_init failed");
+        exit(1);
+    }
+    for (i = 0; i < NR_GREEN; i++) {
+        if ((threads[i] = green_create(worker, (void *)i)) == NULL) {
+            lprintf("green_create failed at %d", i);
+            exit(1);
+        }
+    }
+    for (i = 0; i < NR_GREEN; i++) {
+        green_join(threads[i], &status);
+        if ((int)status != i) {
+            lprintf("Wrong exit status for green thread %d", i);
+            exit(1);
+        }
+    }
+    green_shutdown();
+
+    lprintf("green_test passed");
+    thr_exit(NULL);
+    return 0;
+}
@@ -0,0 +1,336 @@
+/** @file malloc_bench.c
+ *  @brief Replay malloc traces and report throughput and heap usage
+ *
+ *  usage: malloc_bench [threads [trace [rounds]]]
+ *
+ *  Every replay thread replays the whole trace, rounds times, on blocks
+ *  of its own. With threads at most 1 the main thread replays it. The
+ *  trace is one of the synthetic workloads below, or the name of a file
+ *  in the format of the 15-213 malloc driver:
+ *
+ *      <suggested heap size>
+ *      <number of ids>
+ *      <number of ops>
+ *      <weight>
+ *      a <id> <size>
+ *      r <id> <size>
+ *      f <id>
+ *
+ *  The synthetic workloads follow what our programs do:
+ *      small   - short lived small blocks, such as cond_wait and list
+ *                nodes
+ *      fifo    - thread control blocks and thread group entries, freed
+ *                in the order they were allocated
+ *      realloc - buffers grown by doubling, such as line readers and
+ *                strings
+ *      mixed   - sizes from 8 bytes to 512KB, including blocks large
+ *                enough to get pages of their own, some of them resized
+ *
+ *  green.rep is a trace recorded with malloc_trace_start and
+ *  malloc_trace_stop around the body of green_test. It creates 2000
+ *  green threads before it lets any of them exit.
+ *
+ *  The first byte of each block is set to its id and checked when it is
+ *  resized or freed.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <thread.h>
+#include <syscall.h>
+#include <simics.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc_ext.h>
+#include <asm.h>
+
+#define STACK_SIZE (4 * 4096)
+#define MAX_THREADS 32
+#define SYNTHETIC_OPS 20000
+#define READ_CHUNK 4096
+
+/** @brief one step of a trace */
+typedef struct op {
+    char kind;                  /* 'a', 'r' or 'f' */
+    int id;
+    int size;
+} op_t;
+
+typedef struct trace {
+    op_t *ops;
+    int nops;
+    int nids;
+} trace_t;
+
+static trace_t trace;
+static int rounds = 1;
+static int errors = 0;
+
+/** @brief add an op to the trace being built
+ *
+ *  @return 0 on success, -1 if out of memory
+ */
+static int add_op(int *cap, char kind, int id, int size) {
+    op_t *ops;
+
+    if (trace.nops == *cap) {
+        *cap = (*cap == 0) ? 1024 : *cap * 2;
+        if ((ops = realloc(trace.ops, *cap * sizeof(op_t))) == NULL) {
+            return -1;
+        }
+        trace.ops = ops;
+    }
+    trace.ops[trace.nops].kind = kind;
+    trace.ops[trace.nops].id = id;
+    trace.ops[trace.nops].size = size;
+    trace.nops++;
+    return 0;
+}
+
+/** @brief build one of the synthetic traces
+ *
+ *  Ids are taken from a pool of nids, so at most nids blocks are live.
+ *
+ *  @return 0 on success, -1 for an unknown name or if out of memory
+ */
+static int make_synthetic(const char *name) {
+    int cap = 0, live = 0, i, id, size, oldest = 0, newest = 0, resize = 0;
+    int *used;
+
+    if (!strcmp(name, "small")) {
+        trace.nids = 512;
+    } else if (!strcmp(name, "fifo")) {
+        trace.nids = 256;
+    } else if (!strcmp(name, "realloc")) {
+        trace.nids = 64;
+    } else if (!strcmp(name, "mixed")) {
+        trace.nids = 128;
+        resize = 1;
+    } else {
+        return -1;
+    }
+    if ((used = calloc(trace.nids, sizeof(int))) == NULL) {
+        return -1;
+    }
+    srand(410);
+
+    for (i = 0; i < SYNTHETIC_OPS; i++) {
+        if (!strcmp(name, "fifo")) {
+            /* a batch of threads comes and goes */
+            if (live < trace.nids && (live < 64 || rand() % 2)) {
+                id = newest;
+                newest = (newest + 1) % trace.nids;
+                size = (id % 2) ? 224 : 96;
+            } else {
+                id = oldest;
+                oldest = (oldest + 1) % trace.nids;
+                size = 0;
+            }
+        } else if (!strcmp(name, "realloc")) {
+            /* each buffer doubles up to 16KB and starts over */
+            id = rand() % trace.nids;
+            size = used[id] ? 16 << used[id] : 16;
+            if (size > 16 * 1024) {
+                size = 0;
+            }
+        } else {
+            id = rand() % trace.nids;
+            if (!strcmp(name, "small")) {
+                size = 8 + rand() % ((rand() % 4) ? 56 : 248);
+            } else {
+                size = 8 << (rand() % 16);
+                size += rand() % size;
+            }
+            /* mixed also resizes some of its blocks */
+            if (used[id] && (!resize || rand() % 3)) {
+                size = 0;
+            }
+        }
+
+        if (size == 0) {
+            if (add_op(&cap, 'f', id, 0) < 0) {
+                break;
+            }
+            used[id] = 0;
+            live--;
+        } else if (used[id]) {
+            if (add_op(&cap, 'r', id, size) < 0) {
+                break;
+            }
+            used[id]++;
+        } else {
+            if (add_op(&cap, 'a', id, size) < 0) {
+                break;
+            }
+            used[id] = 1;
+            live++;
+        }
+    }
+    free(used);
+    return (i == SYNTHETIC_OPS) ? 0 : -1;
+}
+
+/** @brief read a trace file
+ *
+ *  @return 0 on success, -1 if it can not be read or parsed
+ */
+static int read_trace(char *filename) {
+    char *buf = NULL, *p, *end, *more;
+    int len = 0, got, cap = 0, size, id, i;
+    char kind;
+
+    do {
+        if ((more = realloc(buf, len + READ_CHUNK + 1)) == NULL) {
+            free(buf);
+            return -1;
+        }
+        buf = more;
+        got = readfile(filename, buf + len, READ_CHUNK, len);
+        len += (got > 0) ? got : 0;
+    } while (got == READ_CHUNK);
+    if (got < 0 || len == 0) {
+        free(buf);
+        return -1;
+    }
+    buf[len] = '\0';
+
+    /* the heap size, ids, ops and weight, we only need the ids */
+    p = buf;
+    for (i = 0; i < 4; i++) {
+        id = strtol(p, &end, 10);
+        if (end == p) {
+            free(buf);
+            return -1;
+        }
+        if (i == 1) {
+            trace.nids = id;
+        }
+        p = end;
+    }
+
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            p++;
+        }
+        if ((kind = *p++) == '\0') {
+            break;
+        }
+        id = strtol(p, &p, 10);
+        size = (kind == 'f') ? 0 : strtol(p, &p, 10);
+        if ((kind != 'a' && kind != 'r' && kind != 'f') || id < 0 ||
+            id >= trace.nids || size < 0 || add_op(&cap, kind, id, size) < 0) {
+            free(buf);
+            return -1;
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+/** @brief replay the trace rounds times on blocks of our own
+ *
+ *  @param arg unused
+ *  @return NULL
+ */
+void *replay(void *arg) {
+    void **blocks = calloc(trace.nids, sizeof(void *));
+    int r, i, bad = 0;
+    op_t *op;
+
+    if (blocks == NULL) {
+        atomic_add(&errors, 1);
+        return NULL;
+    }
+    for (r = 0; r < rounds; r++) {
+        for (i = 0, op = trace.ops; i < trace.nops; i++, op++) {
+            if (op->kind != 'a' && blocks[op->id] != NULL &&
+                *(char *)blocks[op->id] != (char)op->id) {
+                bad++;
+            }
+            switch (op->kind) {
+            case 'a':
+                blocks[op->id] = malloc(op->size);
+                break;
+            case 'r':
+                blocks[op->id] = realloc(blocks[op->id], op->size);
+                break;
+            default:
+                free(blocks[op->id]);
+                blocks[op->id] = NULL;
+                break;
+            }
+            if (op->kind != 'f' && blocks[op->id] != NULL) {
+                *(char *)blocks[op->id] = (char)op->id;
+            } else if (op->kind != 'f') {
+                bad++;
+            }
+        }
+        for (i = 0; i < trace.nids; i++) {
+            free(blocks[i]);
+            blocks[i] = NULL;
+        }
+    }
+    free(blocks);
+    if (bad != 0) {
+        atomic_add(&errors, bad);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int nthreads = (argc > 1) ? atoi(argv[1]) : 1;
+    char *name = (argc > 2) ? argv[2] : "small";
+    int tids[MAX_THREADS];
+    struct mallinfo before, after;
+    unsigned int start, ticks, ops;
+    int i;
+
+    if (argc > 3) {
+        rounds = atoi(argv[3]);
+    }
+    if (nthreads > MAX_THREADS || rounds < 1) {
+        printf("usage: malloc_bench [threads [trace [rounds]]]\n");
+        exit(1);
+    }
+    thr_init(STACK_SIZE);
+
+    if (make_synthetic(name) < 0 && read_trace(name) < 0) {
+        printf("malloc_bench: can not load trace %s\n", name);
+        exit(1);
+    }
+
+    before = mallinfo();
+    start = get_ticks();
+    if (nthreads <= 1) {
+        replay(NULL);
+    } else {
+        for (i = 0; i < nthreads; i++) {
+            if ((tids[i] = thr_create(replay, NULL)) < 0) {
+                printf("malloc_bench: thr_create failed\n");
+                exit(1);
+            }
+        }
+        for (i = 0; i < nthreads; i++) {
+            thr_join(tids[i], NULL);
+        }
+    }
+    ticks = get_ticks() - start;
+    after = mallinfo();
+
+    ops = trace.nops * rounds * (nthreads > 1 ? nthreads : 1);
+    printf("malloc_bench: %s, %d thread(s), %u ops in %u ticks, "
+           "%u ops per tick\n", name, (nthreads > 1) ? nthreads : 1, ops,
+           ticks, (ticks != 0) ? ops / ticks : ops);
+    printf("malloc_bench: peak in use %u bytes, %u before the replay\n",
+           after.peak, before.uordblks + before.hblkhd);
+    printf("malloc_bench: heap %u bytes, %u bytes free\n", after.arena,
+           after.fordblks);
+    if (errors != 0) {
+        printf("malloc_bench: %d blocks were lost or corrupted\n", errors);
+    }
+    malloc_stats();
+    lprintf(errors ? "malloc_bench failed" : "malloc_bench passed");
+    thr_exit(NULL);
+    return 0;
+}
@@ -0,0 +1,122 @@
+/** @file parallel_test.c
+ *  @brief Test parallel loops and reductions under every schedule
+ *
+ *  A loop over a range starting below zero counts how often each
+ *  iteration runs, which must be exactly once, and a reduction over the
+ *  same range must match a serial sum. Then loops right below INT_MAX
+ *  and over the whole range of ints must still be cut into chunks which
+ *  cover the range exactly.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <thread.h>
+#include <parallel.h>
+#include <asm.h>
+#include <limits.h>
+#include <simics.h>
+#include <stdlib.h>
+
+#define STACK_SIZE 4096
+#define LO (-500)
+#define HI 1500
+#define NR_SCHEDS 3
+
+static int counts[HI - LO];
+static int errors = 0;
+
+void count_body(int lo, int hi, void *ctx) {
+    int i;
+
+    if (lo >= hi || lo < LO || hi > HI) {
+        atomic_add(&errors, 1);
+        return;
+    }
+    for (i = lo; i < hi; i++) {
+        atomic_add(&counts[i - LO], 1);
+    }
+}
+
+void *sum_body(int lo, int hi, void *ctx) {
+    int sum = 0;
+    int i;
+
+    for (i = lo; i < hi; i++) {
+        sum += i * (i % 7);
+    }
+    return (void *)sum;
+}
+
+void *size_body(int lo, int hi, void *ctx) {
+    if (lo >= hi) {
+        atomic_add(&errors, 1);
+    }
+    return (void *)((unsigned int)hi - (unsigned int)lo);
+}
+
+void *add(void *a, void *b, void *ctx) {
+    return (void *)((unsigned int)a + (unsigned int)b);
+}
+
+int main() {
+    int grains[] = { 0, 1, 37, HI - LO + 10 };
+    int sched, g, i, serial;
+    unsigned int n;
+
+    thr_init(STACK_SIZE);
+
+    serial = (int)sum_body(LO, HI, NULL);
+    for (sched = 0; sched < NR_SCHEDS; sched++) {
+        for (g = 0; g < sizeof(grains) / sizeof(grains[0]); g++) {
+            for (i = 0; i < HI - LO; i++) {
+                counts[i] = 0;
+            }
+            if (parallel_for_sched(LO, HI, grains[g], count_body, NULL,
+                                   sched) < 0) {
+                lprintf("parallel_for_sched failed");
+                exit(1);
+            }
+            for (i = 0; i < HI - LO; i++) {
+                if (counts[i] != 1) {
+                    lprintf("Schedule %d grain %d: iteration %d ran %d times",
+                            sched, grains[g], LO + i, counts[i]);
+                    exit(1);
+                }
+            }
+            if ((int)parallel_reduce_sched(LO, HI, grains[g], sum_body, add,
+                                           NULL, NULL, sched) != serial) {
+                lprintf("Schedule %d grain %d: reduce differs from serial sum",
+                        sched, grains[g]);
+                exit(1);
+            }
+        }
+
+        /* Claims past the end of the range must not wrap around */
+        n = (unsigned int)parallel_reduce_sched(INT_MAX - 1000, INT_MAX, 300,
+                                                size_body, add, NULL, NULL,
+                                                sched);
+        if (n != 1000) {
+            lprintf("Schedule %d: %u iterations below INT_MAX", sched, n);
+            exit(1);
+        }
+        n = (unsigned int)parallel_reduce_sched(INT_MIN, INT_MAX, 0,
+                                                size_body, add, NULL, NULL,
+                                                sched);
+        if (n != UINT_MAX) {
+            lprintf("Schedule %d: %u iterations over all ints", sched, n);
+            exit(1);
+        }
+    }
+    if (errors != 0) {
+        lprintf("%d chunks were empty or out of range", errors);
+        exit(1);
+    }
+    if (parallel_for_sched(LO, HI, 0, count_body, NULL, NR_SCHEDS) >= 0) {
+        lprintf("parallel_for_sched took an unknown schedule");
+        exit(1);
+    }
+
+    lprintf("parallel_test passed");
+    thr_exit(NULL);
+    return 0;
+}
@@ -0,0 +1,116 @@
+/** @file spsc_test.c
+ *  @brief Test single producer, single consumer rings
+ *
+ *  Bulk pushes and pops of varying sizes wrap around a small ring many
+ *  times and must keep the items in order. Then a consumer parks in
+ *  spsc_pop_wait on an empty ring, both while the producer is idle and
+ *  while it streams items, and must get every item.
+ *
+ *  @author Rohit Upadhyaya (rjupadhy)
+ *  @author Prajwal Yadapadithaya (pyadapad)
+ */
+#include <thread.h>
+#include <spsc.h>
+#include <errors.h>
+#include <syscall.h>
+#include <simics.h>
+#include <stdlib.h>
+
+#define STACK_SIZE 4096
+#define CAPACITY 8
+#define NR_ITEMS 20000
+#define NR_PARKED 10
+#define BATCH 5
+
+static spsc_t ring;
+
+void *consumer(void *arg) {
+    int items[BATCH];
+    int n = (int)arg;
+    int next = 0, k, i;
+
+    while (next < n) {
+        if ((k = spsc_pop_wait(&ring, items, BATCH)) <= 0) {
+            return (void *)-1;
+        }
+        for (i = 0; i < k; i++) {
+            if (items[i] != next++) {
+                return (void *)-1;
+            }
+        }
+    }
+    return NULL;
+}
+
+int main() {
+    int items[CAPACITY];
+    int next_in = 0, next_out = 0;
+    int i, k, tid;
+    void *status;
+
+    thr_init(STACK_SIZE);
+
+    /* Wrap around with every batch size, in a single thread */
+    if (spsc_init(&ring, CAPACITY, sizeof(int), 0) < 0) {
+        lprintf("spsc_init failed");
+        exit(1);
+    }
+    while (next_out < NR_ITEMS || next_out < next_in) {
+        if (next_in < NR_ITEMS) {
+            k = 1 + next_in % CAPACITY;
+            for (i = 0; i < k; i++) {
+                items[i] = next_in + i;
+            }
+            next_in += spsc_push_bulk(&ring, items, k);
+        }
+        k = 1 + next_out % (CAPACITY - 1);
+        k = spsc_pop_bulk(&ring, items, k);
+        for (i = 0; i < k; i++) {
+            if (items[i] != next_out++) {
+                lprintf("Item %d popped out of order", next_out - 1);
+                exit(1);
+            }
+        }
+    }
+    if (spsc_pop(&ring, items) != ERR_BUSY) {
+        lprintf("Popped an item from an empty ring");
+        exit(1);
+    }
+    spsc_destroy(&ring);
+
+    /* Wake up a consumer parked on an empty ring, one item at a time */
+    if (spsc_init(&ring, CAPACITY, sizeof(int), SPSC_BLOCKING) < 0) {
+        lprintf("spsc_init failed");
+        exit(1);
+    }
+    tid = thr_create(consumer, (void *)NR_PARKED);
+    for (i = 0; i < NR_PARKED; i++) {
+        sleep(2);
+        while (spsc_push(&ring, &i) < 0) {
+            yield(-1);
+        }
+    }
+    thr_join(tid, &status);
+    if (status != NULL) {
+        lprintf("Parked consumer missed an item");
+        exit(1);
+    }
+
+    /* Stream through the ring with the consumer parking as it drains it */
+    tid = thr_create(consumer, (void *)NR_ITEMS);
+    for (i = 0; i < NR_ITEMS; i++) {
+        while (spsc_push(&ring, &i) < 0) {
+            yield(tid);
+        }
+    }
+    thr_join(tid, &status);
+    if (status != NULL) {
+        lprintf("Consumer lost an item");
+        exit(1);
+    }
+    spsc_destroy(&ring);
+
+    lprintf("spsc_test passed");
+    thr_exit(NULL);
+    return 0;
+}